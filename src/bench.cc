@@ -0,0 +1,209 @@
+#include "bench.hh"
+#include "epd.hh"
+#include "search.hh"
+#include "tt.hh"
+#include "uci.hh"
+
+#include <chrono>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::high_resolution_clock;
+using time_point = high_resolution_clock::time_point;
+
+using namespace chess;
+
+/**
+ * @brief Positions used for benchmarking, a mix of openings, middlegames and endgames,
+ * including a few from the test suites in data/
+ */
+const std::vector<std::string> BenchPositions
+{
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP2BPPP/R2QKB1R w KQ - 0 8",
+	"3r1k2/4npp1/1ppr3p/p6P/P2PPPP1/1NR5/5K2/2R5 w - - 0 1",
+	"2q1rr1k/3bbnnp/p2p1pp1/2pPp3/PpP1P1P1/1P2BNNP/2BQ1PRK/7R b - - 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"8/k7/3p4/p2P1p2/P2P1P2/8/8/K7 w - - 0 1",
+	"1k1r4/pp1b1R2/3q2pp/4p3/2B5/4Q3/PPP2B2/2K5 b - - 0 1",
+	"5rk1/1ppb3p/p1pb4/6q1/3P1p1r/2P1R2P/PP1BQ1P1/5RKN w - - 0 1",
+	"r1bq2rk/pp3pbp/2p1p1pQ/7P/3P4/2PB1N2/PP3PPR/2KR4 w - - 0 1",
+	"8/8/p1p5/1p5p/1P5p/8/PPP2K1p/4R1rk w - - 0 1"
+};
+
+/**
+ * @brief Searches every position to a fixed depth with the given number of threads.
+ * The transposition table is cleared before each position, so that the result for
+ * a position doesn't depend on the positions searched before it.
+ *
+ * @param main_thread
+ * @param fens Positions to search
+ * @param threads Total number of search threads, including the main thread
+ * @param depth
+ * @param nodes Total nodes searched
+ * @param verbose Print the number of nodes searched for each position
+ * @return milliseconds Total time to depth
+ */
+static milliseconds run_bench(search::MainThread &main_thread, const std::vector<std::string> &fens,
+					   unsigned threads, Depth depth, Nodes &nodes, const bool verbose = false)
+{
+	main_thread.resize_helpers(threads - 1);
+
+	search::Limits limits;
+	limits.depth = depth;
+
+	milliseconds total_time {};
+	nodes = 0;
+
+	for (std::size_t i = 0; i < fens.size(); ++i)
+	{
+		const Position position {fens[i]};
+
+		tt.clear();
+		main_thread.initialise(position, {position.key()});
+
+		const time_point t0 = high_resolution_clock::now();
+		main_thread.start_thinking(limits);
+		main_thread.wait_until_idle();
+		const time_point t1 = high_resolution_clock::now();
+
+		total_time += duration_cast<milliseconds>(t1 - t0);
+		nodes += main_thread.total_nodes_searched();
+
+		if (verbose)
+			fmt::print("Position {: >3}/{}: {: >10} {}\n",
+					   i + 1, fens.size(), main_thread.total_nodes_searched(), fens[i]);
+	}
+
+	return total_time;
+}
+
+/**
+ * @brief Parallel search scaling benchmark. Measures time to depth over the bench positions
+ * with 1, 2, 4, 8 and 16 threads, and reports the speedup relative to one thread.
+ */
+int chess::smp_bench(int argc, char *argv[])
+{
+	Depth depth = 10;
+	search::ParallelSearch algorithm = search::ParallelSearch::LazySMP;
+
+	try
+	{
+		if (argc >= 3)
+			depth = std::stoul(argv[2]);
+
+		if (argc >= 4)
+		{
+			if (std::string_view {argv[3]} == "ABDADA")
+				algorithm = search::ParallelSearch::ABDADA;
+			else if (std::string_view {argv[3]} != "LazySMP")
+				throw std::invalid_argument(argv[3]);
+		}
+	}
+	catch (const std::exception &e)
+	{
+		fmt::print("Usage: {} smpbench [depth = {}] [LazySMP | ABDADA]\n", argv[0], depth);
+		return EXIT_FAILURE;
+	}
+
+	uci::quiet = true;
+
+	search::MainThread main_thread;
+	main_thread.set_parallel_search(algorithm);
+
+	fmt::print("{: <8} {: <12} {: <14} {: <12} {: <8}\n",
+			   "Threads", "Time (ms)", "Nodes", "knodes/sec", "Speedup");
+
+	milliseconds single_thread_time {};
+
+	for (unsigned threads : {1, 2, 4, 8, 16})
+	{
+		Nodes nodes;
+		const milliseconds time = run_bench(main_thread, BenchPositions, threads, depth, nodes);
+
+		if (threads == 1)
+			single_thread_time = time;
+
+		fmt::print("{: <8} {: <12} {: <14} {: <12.0f} {: <8.2f}\n",
+			threads, time.count(), nodes, double(nodes) / (time.count() + 1),
+			double(single_thread_time.count()) / (time.count() + 1)
+		);
+	}
+
+	uci::quiet = false;
+
+	return 0;
+}
+
+/**
+ * @brief Searches the bench positions (and optionally the positions in an EPD file) to a
+ * fixed depth, and reports the total number of nodes searched and the speed. With one
+ * thread the search is deterministic, so the node count is a signature of the search:
+ * it only changes when the behaviour of the engine changes.
+ */
+int chess::bench(int argc, char *argv[])
+{
+	Depth depth = DefaultBenchDepth;
+	unsigned threads = 1;
+	std::size_t hash = TranspositionTable::DefaultSize / 1024 / 1024;
+	std::vector<std::string> fens = BenchPositions;
+
+	try
+	{
+		if (argc >= 3)
+			depth = std::stoul(argv[2]);
+
+		if (argc >= 4)
+			threads = std::stoul(argv[3]);
+
+		if (argc >= 5)
+			hash = std::stoul(argv[4]);
+
+		if (threads == 0 || hash == 0)
+			throw std::out_of_range("threads and hash must be non-zero");
+	}
+	catch (const std::exception &e)
+	{
+		fmt::print("Usage: {} bench [depth = {}] [threads = 1] [hash (MiB) = {}] [epd file]\n",
+				   argv[0], DefaultBenchDepth, TranspositionTable::DefaultSize / 1024 / 1024);
+		return EXIT_FAILURE;
+	}
+
+	if (argc >= 6)
+	{
+		const std::vector<EPD> epds = read_epd_file(argv[5]);
+
+		if (epds.empty())
+		{
+			fmt::print("Failed to read positions from {}\n", argv[5]);
+			return EXIT_FAILURE;
+		}
+
+		for (const EPD &epd : epds)
+			fens.push_back(epd.fen);
+	}
+
+	uci::quiet = true;
+	tt.resize(hash * 1024 * 1024);
+
+	search::MainThread main_thread;
+
+	Nodes nodes;
+	const milliseconds time = run_bench(main_thread, fens, threads, depth, nodes, true);
+
+	uci::quiet = false;
+
+	fmt::print(
+		"depth:      {}\nthreads:    {}\nhash:       {} MiB\n"
+		"nodes:      {}\nknodes/sec: {:.0f}\ntime taken: {} ms\n",
+		depth, threads, hash, nodes, double(nodes) / (time.count() + 1), time.count()
+	);
+
+	// Only meaningful when the search is deterministic
+	if (threads == 1)
+		fmt::print("signature:  {}\n", nodes);
+
+	return 0;
+}
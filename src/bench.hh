@@ -0,0 +1,11 @@
+#pragma once
+
+#include "types.hh"
+
+namespace chess
+{
+	constexpr Depth DefaultBenchDepth = 8;
+
+	extern int bench(int argc, char *argv[]);
+	extern int smp_bench(int argc, char *argv[]);
+} // chess
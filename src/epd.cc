@@ -0,0 +1,405 @@
+#include "epd.hh"
+#include "movegen.hh"
+#include "search.hh"
+#include "uci.hh"
+
+#include "threading/pool.hh"
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+using std::chrono::milliseconds;
+
+using namespace chess;
+
+/**
+ * @brief Removes leading and trailing whitespace
+ *
+ * @param s
+ * @return std::string
+ */
+static std::string trim(std::string_view s)
+{
+	const std::size_t first = s.find_first_not_of(" \t\r\n");
+	const std::size_t last  = s.find_last_not_of(" \t\r\n");
+
+	return first == std::string_view::npos ? std::string {} : std::string {s.substr(first, last - first + 1)};
+}
+
+/**
+ * @brief Parses a single EPD record
+ *
+ * @param line
+ * @return EPD
+ */
+EPD chess::parse_epd(std::string_view line)
+{
+	EPD epd;
+	std::istringstream iss {std::string {line}};
+
+	// Piece placement, side to move, castling rights, en passant square
+	for (int i = 0; i < 4; ++i)
+	{
+		std::string field;
+		iss >> field;
+		epd.fen += field + ' ';
+	}
+
+	// Operations, separated by semicolons
+	std::string operation;
+	while (std::getline(iss, operation, ';'))
+	{
+		operation = trim(operation);
+		if (operation.empty())
+			continue;
+
+		const std::size_t space = operation.find(' ');
+		const std::string opcode = operation.substr(0, space);
+		std::string operand = space == std::string::npos ? std::string {} : trim(operation.substr(space));
+
+		if (operand.size() >= 2 && operand.front() == '"' && operand.back() == '"')
+			operand = operand.substr(1, operand.size() - 2);
+
+		epd.operations[opcode] = operand;
+	}
+
+	epd.fen += epd.has("hmvc") ? epd.operations["hmvc"] : "0";
+	epd.fen += ' ';
+	epd.fen += epd.has("fmvn") ? epd.operations["fmvn"] : "1";
+
+	return epd;
+}
+
+/**
+ * @brief Reads every EPD record in a file, skipping empty lines and comments (lines starting with #)
+ *
+ * @param path
+ * @return std::vector<EPD> Empty if the file couldn't be read
+ */
+std::vector<EPD> chess::read_epd_file(const std::string &path)
+{
+	std::vector<EPD> epds;
+	std::ifstream file {path};
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		line = trim(line);
+
+		if (!line.empty() && line[0] != '#')
+			epds.push_back(parse_epd(line));
+	}
+
+	return epds;
+}
+
+/**
+ * @brief Finds the legal move matching a move in Standard Algebraic Notation (e.g. Nbd7, exd8=Q+, O-O)
+ *
+ * @param position
+ * @param san
+ * @return Move Null move if there is no such legal move, or if it is ambiguous
+ */
+Move chess::parse_san(const Position &position, std::string_view san)
+{
+	const MoveList move_list {position};
+
+	// Remove check, mate and capture indicators, and annotations
+	std::string s;
+	for (const char c : san)
+		if (std::string_view {"+#x!?"}.find(c) == std::string_view::npos)
+			s += c;
+
+	if (s == "O-O" || s == "0-0" || s == "O-O-O" || s == "0-0-0")
+	{
+		const bool kingside = s.size() == 3;
+
+		for (const Move move : move_list)
+		{
+			if (position.type_of_piece_on(move.from()) == PieceType::King
+				&& util::abs(int(file_of(move.to())) - int(file_of(move.from()))) == 2
+				&& (file_of(move.to()) > file_of(move.from())) == kingside)
+				return move;
+		}
+
+		return {};
+	}
+
+	// Promotion, either e8=Q or e8Q
+	PieceType promotion = PieceType::Invalid;
+	if (const std::size_t eq = s.find('='); eq != std::string::npos && eq + 1 < s.size())
+	{
+		promotion = static_cast<PieceType>(PieceTypeCharsUpper.find(s[eq + 1]));
+		s.erase(eq);
+	}
+	else if (s.size() >= 3 && PieceTypeCharsUpper.find(s.back()) != std::string_view::npos)
+	{
+		promotion = static_cast<PieceType>(PieceTypeCharsUpper.find(s.back()));
+		s.pop_back();
+	}
+
+	if (s.size() < 2)
+		return {};
+
+	const Square to = parse_square(s.substr(s.size() - 2));
+	s.erase(s.size() - 2);
+
+	if (!is_valid(to))
+		return {};
+
+	PieceType piece = PieceType::Pawn;
+	if (!s.empty() && PieceTypeCharsUpper.find(s[0]) != std::string_view::npos)
+	{
+		piece = static_cast<PieceType>(PieceTypeCharsUpper.find(s[0]));
+		s.erase(0, 1);
+	}
+
+	// Anything left disambiguates between moves of the same type of piece
+	int from_file = -1, from_rank = -1;
+	for (const char c : s)
+	{
+		if (c >= 'a' && c <= 'h')
+			from_file = c - 'a';
+		else if (c >= '1' && c <= '8')
+			from_rank = c - '1';
+		else
+			return {};
+	}
+
+	Move found;
+
+	for (const Move move : move_list)
+	{
+		if (move.to() != to || move.promotion() != promotion
+			|| position.type_of_piece_on(move.from()) != piece
+			|| (from_file >= 0 && int(file_of(move.from())) != from_file)
+			|| (from_rank >= 0 && int(rank_of(move.from())) != from_rank))
+			continue;
+
+		if (found.is_valid())
+			return {};
+
+		found = move;
+	}
+
+	return found;
+}
+
+/**
+ * @brief Parses a space separated list of SAN moves, e.g. the operand of bm/am.
+ * Moves which aren't legal in the position are left out.
+ *
+ * @param position
+ * @param moves
+ * @return MoveSequence
+ */
+MoveSequence chess::parse_san_moves(const Position &position, std::string_view moves)
+{
+	MoveSequence parsed;
+	std::istringstream iss {std::string {moves}};
+	std::string san;
+
+	while (iss >> san)
+		if (const Move move = parse_san(position, san); move.is_valid())
+			parsed.push_back(move);
+
+	return parsed;
+}
+
+/**
+ * @brief Result of searching one EPD position
+ */
+struct EPDResult
+{
+	std::string id, expected;
+	bool avoid = false, solved = false;
+
+	Move move;
+	Depth depth = 0;
+	Nodes nodes = 0;
+	milliseconds time {};
+
+	// Time/nodes/depth at which the engine settled on a correct move, if it did
+	Depth depth_to_solution = 0;
+	Nodes nodes_to_solution = 0;
+	milliseconds time_to_solution {};
+};
+
+/**
+ * @brief Searches one EPD position. The position is solved once the best move is one of the
+ * bm moves (or isn't one of the am moves), as long as it doesn't change to a wrong move later.
+ *
+ * @param main_thread Search instance to use
+ * @param epd
+ * @param limits
+ * @return EPDResult
+ */
+static EPDResult solve(search::MainThread &main_thread, const EPD &epd, const search::Limits &limits)
+{
+	const Position position {epd.fen};
+
+	EPDResult result;
+	result.id = epd.has("id") ? epd.operations.at("id") : epd.fen;
+	result.avoid = !epd.has("bm");
+	result.expected = result.avoid ? epd.operations.at("am") : epd.operations.at("bm");
+
+	const MoveSequence expected_moves = parse_san_moves(position, result.expected);
+
+	const auto is_correct = [&] (const Move move)
+	{
+		const bool listed = std::find(expected_moves.begin(), expected_moves.end(), move)
+						 != expected_moves.end();
+
+		return listed != result.avoid;
+	};
+
+	bool correct = false;
+
+	main_thread.on_iteration([&] (const search::MainThread &thread)
+	{
+		const Move move = thread.principal_variation()[0];
+
+		if (is_correct(move) && !correct)
+		{
+			result.depth_to_solution = thread.depth_reached();
+			result.nodes_to_solution = thread.total_nodes_searched();
+			result.time_to_solution  = thread.total_search_time();
+		}
+
+		correct = is_correct(move);
+	});
+
+	main_thread.initialise(position, {position.key()});
+	main_thread.start_thinking(limits);
+	main_thread.wait_until_idle();
+	main_thread.on_iteration(nullptr);
+
+	const MoveSequence &pv = main_thread.principal_variation();
+
+	result.move   = pv.empty() ? Move {} : pv[0];
+	result.depth  = main_thread.depth_reached();
+	result.nodes  = main_thread.total_nodes_searched();
+	result.time   = main_thread.total_search_time();
+	result.solved = !pv.empty() && is_correct(result.move) && correct;
+
+	return result;
+}
+
+/**
+ * @brief Runs a test suite of EPD positions with bm or am operations.
+ * Positions are searched concurrently by independent single-threaded search instances,
+ * and the results are printed as CSV. Each instance has its own transposition table,
+ * which is cleared before every position, so a result doesn't depend on which positions
+ * were searched before it (it still depends on timing, as the search is limited by time).
+ */
+int chess::epd(int argc, char *argv[])
+{
+	std::vector<std::string> paths;
+	unsigned movetime = 1000, instances = threading::max_threads();
+
+	try
+	{
+		for (int i = 2; i < argc; ++i)
+		{
+			const std::string_view arg {argv[i]};
+
+			if (arg == "--movetime" && i + 1 < argc)
+				movetime = std::stoul(argv[++i]);
+			else if (arg == "--instances" && i + 1 < argc)
+				instances = std::stoul(argv[++i]);
+			else
+				paths.emplace_back(arg);
+		}
+
+		if (paths.empty() || instances == 0)
+			throw std::invalid_argument("no EPD files given");
+	}
+	catch (const std::exception &e)
+	{
+		fmt::print("Usage: {} epd [--movetime ms = 1000] [--instances n = {}] files...\n",
+				   argv[0], threading::max_threads());
+		return EXIT_FAILURE;
+	}
+
+	std::vector<EPD> epds;
+
+	for (const std::string &path : paths)
+	{
+		std::vector<EPD> file_epds = read_epd_file(path);
+
+		if (file_epds.empty())
+		{
+			fmt::print("Failed to read positions from {}\n", path);
+			return EXIT_FAILURE;
+		}
+
+		for (EPD &epd : file_epds)
+			if (epd.has("bm") || epd.has("am"))
+				epds.push_back(std::move(epd));
+	}
+
+	search::Limits limits;
+	limits.tc.movetime = milliseconds {movetime};
+
+	uci::quiet = true;
+
+	std::vector<EPDResult> results(epds.size());
+	std::atomic<std::size_t> next {0};
+
+	// Each instance takes the next unsearched position until there are none left.
+	// Instance i runs on worker i, and so do its searches: waiting for the search runs it
+	// in place, as pinned tasks are only ever taken by their own worker.
+	{
+		threading::ThreadPool pool {instances};
+		threading::TaskGroup group;
+
+		for (unsigned i = 0; i < instances; ++i)
+		{
+			pool.submit_to(i, [&, i]
+			{
+				TranspositionTable table {TranspositionTable::DefaultSize};
+				search::MainThread main_thread {&pool, i};
+				main_thread.set_table(table);
+
+				for (std::size_t j = next++; j < epds.size(); j = next++)
+				{
+					table.clear();
+					results[j] = solve(main_thread, epds[j], limits);
+				}
+			}, group);
+		}
+
+		pool.wait(group);
+	}
+
+	uci::quiet = false;
+
+	fmt::print("id,expected,type,move,solved,depth,nodes,time_ms,"
+			   "depth_to_solution,nodes_to_solution,time_to_solution_ms\n");
+
+	std::size_t solved = 0;
+	Nodes nodes_to_solution = 0;
+	milliseconds time_to_solution {};
+
+	for (const EPDResult &result : results)
+	{
+		fmt::print("\"{}\",\"{}\",{},{},{},{},{},{},{},{},{}\n",
+				   result.id, result.expected, result.avoid ? "am" : "bm", uci::format_move(result.move),
+				   result.solved, result.depth, result.nodes, result.time.count(),
+				   result.depth_to_solution, result.nodes_to_solution, result.time_to_solution.count());
+
+		if (result.solved)
+		{
+			++solved;
+			nodes_to_solution += result.nodes_to_solution;
+			time_to_solution  += result.time_to_solution;
+		}
+	}
+
+	fmt::print("# solved {}/{}, total time to solution {} ms, total nodes to solution {}\n",
+			   solved, results.size(), time_to_solution.count(), nodes_to_solution);
+
+	return 0;
+}
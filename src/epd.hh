@@ -0,0 +1,36 @@
+#pragma once
+
+#include "position.hh"
+#include "types.hh"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace chess
+{
+	/**
+	 * @brief Position in Extended Position Description format, e.g.
+	 * 2q1rr1k/3bbnnp/p2p1pp1/2pPp3/PpP1P1P1/1P2BNNP/2BQ1PRK/7R b - - bm f5; id "BK.03";
+	 */
+	struct EPD
+	{
+		// FEN string, with the half-move clock and full-move number taken from
+		// the hmvc and fmvn operations if present
+		std::string fen;
+
+		// Operands of each operation, by opcode. Quotes around string operands are removed.
+		std::unordered_map<std::string, std::string> operations;
+
+		bool has(const std::string &opcode) const { return operations.count(opcode); }
+	};
+
+	extern EPD parse_epd(std::string_view line);
+	extern std::vector<EPD> read_epd_file(const std::string &path);
+
+	extern Move parse_san(const Position &position, std::string_view san);
+	extern MoveSequence parse_san_moves(const Position &position, std::string_view moves);
+
+	extern int epd(int argc, char *argv[]);
+} // chess
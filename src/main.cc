@@ -1,3 +1,5 @@
+#include "bench.hh"
+#include "epd.hh"
 #include "perft.hh"
 #include "uci.hh"
 
@@ -27,10 +29,14 @@ int main(int argc, char *argv[])
 
 	if (option_exists(argc, argv, "perft") || option_exists(argc, argv, "divide"))
 		status = perft(argc, argv);
+	else if (option_exists(argc, argv, "perftbench"))
+		status = perft_bench(argc, argv);
+	else if (option_exists(argc, argv, "smpbench"))
+		status = smp_bench(argc, argv);
+	else if (option_exists(argc, argv, "epd"))
+		status = epd(argc, argv);
 	else if (option_exists(argc, argv, "bench"))
-	{
-		// Benchmark
-	}
+		status = bench(argc, argv);
 	else
 	{
 		std::string line;
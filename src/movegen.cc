@@ -1,5 +1,8 @@
 #include "movegen.hh"
 
+#include <functional>
+#include <limits>
+
 using namespace chess;
 
 template <PieceType T>
@@ -225,7 +228,7 @@ void append_pawn_moves(MoveList &move_list, const Position &position, Bitboard t
 	}
 }
 
-void MoveList::generate()
+void MoveList::generate(const Position &position, const Colour us)
 {
 	const Square ksq = position.king_square(us);
 	const Bitboard checkers = position.checkers();
@@ -281,8 +284,285 @@ void MoveList::generate()
 						: append_pawn_moves<Colour::Black>(*this, position, targets);
 }
 
-MoveWithValue MoveList::select()
+template <PieceType T>
+unsigned count_moves(const Position &position, const Colour us, const Bitboard targets)
+{
+	static_assert(T != PieceType::Pawn && T != PieceType::King, "Unsupported piece type");
+
+	const Square ksq = position.king_square(us);
+	const Bitboard pinned = position.pinned();
+	const Bitboard occ = position.occupied();
+
+	unsigned count = 0;
+
+	Bitboard pieces = position.occupied(us, T);
+	while (pieces)
+	{
+		const Square from = static_cast<Square>(util::lsb_64(pieces));
+
+		// Pinned pieces can only move along the line through the king
+		Bitboard attacks = attacks_from<T>(from, occ) & targets;
+		if (pinned & from)
+			attacks &= line_connecting(ksq, from);
+
+		count += util::popcount_64(attacks);
+
+		pieces &= (pieces - 1);
+	}
+
+	return count;
+}
+
+unsigned count_king_moves(const Position &position, const Colour us, const Bitboard targets)
+{
+	const Square ksq = position.king_square(us);
+	const Bitboard enemy = position.occupied(~us);
+	const Bitboard occ = position.occupied();
+
+	unsigned count = 0;
+
+	// Every destination has to be tested for attacks, so there is nothing to gain over generating
+	Bitboard attacks = attacks_from<PieceType::King>(ksq) & targets;
+	while (attacks)
+	{
+		const Square to = static_cast<Square>(util::lsb_64(attacks));
+
+		count += (position.attackers_to(to, occ ^ ksq) & enemy) == 0;
+
+		attacks &= (attacks - 1);
+	}
+
+	return count;
+}
+
+#if defined(CRAZYHOUSE)
+template <PieceType T>
+unsigned count_drops(const Position &position, const Colour us, Bitboard targets)
+{
+	if (!position.hand_count(make_piece(us, T)))
+		return 0;
+
+	targets &= ~position.occupied();
+
+	if constexpr (T == PieceType::Pawn)
+		targets &= ~(Rank1BB | Rank8BB);
+
+	return util::popcount_64(targets);
+}
+#endif
+
+template <Colour Us>
+unsigned count_pawn_moves(const Position &position, const Bitboard targets)
+{
+	constexpr Rank Rank3 = Us == Colour::White ? Rank::Three : Rank::Six;
+	constexpr Rank Rank7 = Us == Colour::White ? Rank::Seven : Rank::Two;
+	constexpr Direction Up = pawn_push(Us);
+	constexpr Direction UpWest = Up + West, UpEast = Up + East;
+
+	const Square ksq = position.king_square(Us);
+	const Bitboard pinned = position.pinned();
+	const Bitboard pawns = position.occupied(Us, PieceType::Pawn);
+	const Bitboard occ = position.occupied(), empty = ~occ, enemy = position.occupied(~Us);
+
+	unsigned count = 0;
+
+	// En passant, at most two candidates which need the full discovered check test
+	if (position.has_en_passant())
+	{
+		const Square en_passant = position.en_passant_square();
+		const Square target_sq = en_passant + pawn_push(~Us);
+		if (targets & target_sq)
+		{
+			Bitboard candidates = pawn_attacks(~Us, en_passant) & pawns;
+			while (candidates)
+			{
+				const Square from = static_cast<Square>(util::lsb_64(candidates));
+
+				const Bitboard nocc = (occ ^ from ^ target_sq) | en_passant;
+				count += !(position.attackers_to<PieceType::Bishop, PieceType::Rook>(ksq, nocc) & enemy);
+
+				candidates &= (candidates - 1);
+			}
+		}
+	}
+
+	// Pinned pawns can only move along the line through the king, count them one at a time
+	Bitboard pinned_pawns = pawns & pinned;
+	while (pinned_pawns)
+	{
+		const Square from = static_cast<Square>(util::lsb_64(pinned_pawns));
+		const Bitboard pawn = square_bb(from);
+
+		const Bitboard single_push = shift<Up>(pawn) & empty;
+		const Bitboard double_push = shift<Up>(single_push & Rank3) & empty;
+		const Bitboard captures = pawn_attacks(Us, from) & enemy;
+
+		const Bitboard moves = (single_push | double_push | captures) & targets
+							 & line_connecting(ksq, from);
+
+		// Promotions come in fours
+		count += util::popcount_64(moves) * ((pawn & Rank7) ? 4 : 1);
+
+		pinned_pawns &= (pinned_pawns - 1);
+	}
+
+	const Bitboard free_pawns = pawns & ~pinned;
+	const Bitboard pawns_on_7 = free_pawns & Rank7, pawns_not_on_7 = free_pawns & ~pawns_on_7;
+
+	// Promotions, w/ and w/o captures
+	count += 4 * (util::popcount_64(shift<Up>(pawns_on_7) & empty & targets)
+				+ util::popcount_64(shift<UpWest>(pawns_on_7) & enemy & targets)
+				+ util::popcount_64(shift<UpEast>(pawns_on_7) & enemy & targets));
+
+	// Pawn pushes
+	const Bitboard single_push = shift<Up>(pawns_not_on_7) & empty;
+	count += util::popcount_64(single_push & targets)
+		   + util::popcount_64(shift<Up>(single_push & Rank3) & empty & targets);
+
+	// Captures, w/o promotion
+	count += util::popcount_64(shift<UpWest>(pawns_not_on_7) & enemy & targets)
+		   + util::popcount_64(shift<UpEast>(pawns_not_on_7) & enemy & targets);
+
+	return count;
+}
+
+unsigned chess::count_legal_moves(const Position &position)
+{
+	const Colour us = position.side_to_move();
+	const Square ksq = position.king_square(us);
+	const Bitboard checkers = position.checkers();
+
+	Bitboard targets = ~position.occupied(us);
+
+	unsigned count = count_king_moves(position, us, targets);
+
+	if (checkers)
+	{
+		if (more_than_one(checkers))
+			return count;
+
+		const Square checker = static_cast<Square>(util::lsb_64(checkers));
+		targets &= line_between(ksq, checker) | checkers;
+	}
+	else
+	{
+		count += position.can_castle(make_castling_rights(us, true));
+		count += position.can_castle(make_castling_rights(us, false));
+	}
+
+#if defined(CRAZYHOUSE)
+	if (position.is_crazyhouse())
+	{
+		count += count_drops<PieceType::Queen> (position, us, targets);
+		count += count_drops<PieceType::Rook>  (position, us, targets);
+		count += count_drops<PieceType::Bishop>(position, us, targets);
+		count += count_drops<PieceType::Knight>(position, us, targets);
+		count += count_drops<PieceType::Pawn>  (position, us, targets);
+	}
+#endif
+
+	count += count_moves<PieceType::Queen> (position, us, targets);
+	count += count_moves<PieceType::Rook>  (position, us, targets);
+	count += count_moves<PieceType::Bishop>(position, us, targets);
+	count += count_moves<PieceType::Knight>(position, us, targets);
+
+	count += us == Colour::White ? count_pawn_moves<Colour::White>(position, targets)
+								 : count_pawn_moves<Colour::Black>(position, targets);
+
+	ASSERT(count == MoveList {position}.size());
+
+	return count;
+}
+
+/**
+ * @brief Sorts the moves not yet selected by descending value. Each value and the index of its
+ * move are packed into one 32-bit integer, with the (offset) value in the upper half, so they are
+ * sorted with plain integer comparisons.
+ *
+ * Moves with equal values are returned in the same order as by selection steps. A selection step
+ * swaps the move it selects with the first unselected move, which may move a lower valued move
+ * past others of equal value, so these swaps are replayed on the indices after sorting.
+ * The moves of one value are never moved while they are being selected, so they are selected
+ * in the order of their positions.
+ */
+void MoveList::sort_remaining()
 {
-	std::iter_swap(cur, std::max_element(cur, end()));
-	return *cur++;
+	// Each move and its value are also packed together, to be read back through their index
+	util::array_t<std::uint32_t, MaxMoves> keys, unsorted;
+
+	for (unsigned i = cur; i < top; ++i)
+	{
+		const std::uint32_t value = std::uint32_t(values[i] - std::numeric_limits<Value>::min()) << 16;
+
+		keys[i] = value | i;
+		unsorted[i] = value | moves[i].data;
+	}
+
+	std::sort(keys.begin() + cur, keys.begin() + top, std::greater<std::uint32_t> {});
+
+	// Index of the move at each position, and position of each move, as selection steps swap them
+	util::array_t<std::uint16_t, MaxMoves> at, position;
+
+	for (unsigned i = cur; i < top; ++i)
+		at[i] = position[i] = std::uint16_t(i);
+
+	util::array_t<std::uint16_t, MaxMoves> positions;
+	unsigned next = cur;
+
+	for (unsigned first = cur, last; first < top; first = last)
+	{
+		// Positions of the moves with the next highest value, in ascending order. Groups are
+		// small, and their moves have only been moved if they were swapped to the front.
+		for (last = first; last < top && keys[last] >> 16 == keys[first] >> 16; ++last)
+		{
+			const std::uint16_t p = position[keys[last] & 0xffff];
+			unsigned j = last;
+
+			for (; j > first && positions[j - 1] > p; --j)
+				positions[j] = positions[j - 1];
+
+			positions[j] = p;
+		}
+
+		// The first unselected move is swapped to where the selected move was
+		for (unsigned i = first; i < last; ++i, ++next)
+		{
+			const std::uint16_t displaced = at[next];
+
+			at[next] = at[positions[i]];
+			at[positions[i]] = displaced;
+			position[displaced] = positions[i];
+		}
+	}
+
+	for (unsigned i = cur; i < top; ++i)
+	{
+		values[i] = Value((unsorted[at[i]] >> 16) + std::numeric_limits<Value>::min());
+		moves[i].data = std::uint16_t(unsorted[at[i]]);
+	}
+
+	sorted = true;
+}
+
+Move MoveList::select()
+{
+	if (sorted)
+		return moves[cur++];
+
+	// The node has not failed high yet, so it will probably search every move
+	if (cur == SelectionSortMoves)
+	{
+		sort_remaining();
+		return moves[cur++];
+	}
+
+	// First move with the highest value, as std::max_element would find
+	unsigned best = cur;
+	for (unsigned i = cur + 1; i < top; ++i)
+		best = values[i] > values[best] ? i : best;
+
+	std::swap(moves[cur], moves[best]);
+	std::swap(values[cur], values[best]);
+
+	return moves[cur++];
 }
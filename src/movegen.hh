@@ -4,36 +4,28 @@
 
 namespace chess
 {
-	/**
-	 * @brief Move with value, used in move ordering
-	 */
-	struct MoveWithValue : Move
-	{
-		Value value = 0;
-
-		constexpr bool operator<(const MoveWithValue &other) const
-		{
-			return value < other.value;
-		}
-	};
+	// Number of moves picked by a selection sort step before the rest of the list is sorted.
+	// Most cut-nodes fail high within the first few moves, and sorting would be wasted on them.
+	constexpr unsigned SelectionSortMoves = 3;
 
 	/**
-	 * @brief Legal move generator
+	 * @brief Legal move generator. Moves and their move ordering values are kept in separate
+	 * arrays, so generating moves only touches the (16-bit) moves, and selecting the best move
+	 * scans a contiguous array of values.
 	 */
 	class MoveList
 	{
 	private:
-		const Position &position;
-		const Colour us;
-
-		util::array_t<MoveWithValue, MaxMoves> moves;
-		MoveWithValue *top, *cur;
+		util::array_t<Move, MaxMoves> moves;
+		util::array_t<Value, MaxMoves> values;
+		unsigned top, cur;
+		bool sorted;
 
 	public:
 		MoveList(const Position &position, const Colour us)
-			: position(position), us(us), moves(), top(begin()), cur(begin())
+			: top(0), cur(0), sorted(false)
 		{
-			generate();
+			generate(position, us);
 		}
 
 		MoveList(const Position &position)
@@ -42,25 +34,47 @@ namespace chess
 		}
 
 	private:
-		void generate();
+		void generate(const Position &position, const Colour us);
+		void sort_remaining();
 	
 	public:
-		void clear() { top = begin(); cur = begin(); }
+		void clear() { top = 0; cur = 0; sorted = false; }
 
-		void push_back(const Move &move) { ASSERT(size() < moves.size()); *top++ = {move}; }
+		void push_back(const Move &move)
+		{
+			ASSERT(size() < moves.size());
+
+			moves[top++] = move;
+		}
+
+		const Move *begin() const { return moves.data(); }
+		const Move *end()   const { return moves.data() + top; }
 
-		const MoveWithValue *begin() const { return moves.data(); }
-		const MoveWithValue *end()   const { return top; }
-		MoveWithValue *begin() { return moves.data(); }
-		MoveWithValue *end()   { return top; }
+		unsigned size() const { return top; }
 
-		unsigned size() const { return end() - begin(); }
+		Move operator[](const unsigned i) const { return moves[i]; }
+
+		/**
+		 * @brief Move ordering value of the i-th move. Values are left unset by move generation,
+		 * and must be assigned to every move before selecting moves.
+		 */
+		Value &value(const unsigned i) { return values[i]; }
+		Value value(const unsigned i) const { return values[i]; }
 		
 		bool find(const Move &move) const
 		{
 			return std::find(begin(), end(), move) != end();
 		}
 
-		MoveWithValue select();
+		Move select();
 	};
+
+	/**
+	 * @brief Counts the legal moves in a position without generating them,
+	 * by counting the bits in each piece's set of legal destination squares.
+	 *
+	 * @param position
+	 * @return unsigned Same as MoveList {position}.size()
+	 */
+	extern unsigned count_legal_moves(const Position &position);
 }
@@ -16,11 +16,14 @@ constexpr Value QuietsOffset      = 10000;
 void search::evaluate_move_list(const Position &position, MoveList &move_list, const Depth depth,
 								const Move &hash_move, const Heuristics &heuristics)
 {
-	for (MoveWithValue &move : move_list)
+	for (unsigned i = 0; i < move_list.size(); ++i)
 	{
+		const Move move = move_list[i];
+		Value &value = move_list.value(i);
+
 		if (move == hash_move)
 		{
-			move.value = HashMoveOffset;
+			value = HashMoveOffset;
 			continue;
 		}
 
@@ -29,27 +32,27 @@ void search::evaluate_move_list(const Position &position, MoveList &move_list, c
 
 		if (move.is_promotion())
 		{
-			move.value = PromotionsOffset + piece_value(move.promotion());
-			move.value += is_capture ? piece_value(type_of(position.captured_piece(move)))
-									 : 0;
+			value = PromotionsOffset + piece_value(move.promotion());
+			value += is_capture ? piece_value(type_of(position.captured_piece(move)))
+								: 0;
 		}
 		else if (is_capture)
 		{
 			// todo: static exchange evaluation
 			//const Value see = position.see(move);
-			//move.value = CapturesOffset + see;
+			//value = CapturesOffset + see;
 			//continue;
 			const Piece captured_piece = position.captured_piece(move);
 			const Value delta = piece_value(type_of(captured_piece)) - piece_value(type_of(moved_piece));
 
-			move.value = CapturesOffset + delta;
+			value = CapturesOffset + delta;
 		}
 		else
 		{
 			if (heuristics.killer[depth].is_killer(move))
-				move.value = KillerMovesOffset;
+				value = KillerMovesOffset;
 			else
-				move.value = QuietsOffset + heuristics.history.probe(moved_piece, move.to());
+				value = QuietsOffset + heuristics.history.probe(moved_piece, move.to());
 			
 			// todo: pawn sac bonus?
 		}
@@ -58,23 +61,29 @@ void search::evaluate_move_list(const Position &position, MoveList &move_list, c
 
 void search::evaluate_move_list(const Position &position, MoveList &move_list)
 {
-	for (MoveWithValue &move : move_list)
+	for (unsigned i = 0; i < move_list.size(); ++i)
 	{
+		const Move move = move_list[i];
+		Value &value = move_list.value(i);
+
 		const bool is_capture = position.is_capture(move);
 		const Piece moved_piece = position.moved_piece(move);
 
 		if (move.is_promotion())
 		{
-			move.value = PromotionsOffset + piece_value(move.promotion());
-			move.value += is_capture ? piece_value(type_of(position.captured_piece(move)))
-									 : 0;
+			value = PromotionsOffset + piece_value(move.promotion());
+			value += is_capture ? piece_value(type_of(position.captured_piece(move)))
+								: 0;
 		}
 		else if (is_capture)
 		{
 			const Piece captured_piece = position.captured_piece(move);
 			const Value delta = piece_value(type_of(captured_piece)) - piece_value(type_of(moved_piece));
 
-			move.value = CapturesOffset + delta;
+			value = CapturesOffset + delta;
 		}
+		// Quiet moves are only searched in check
+		else
+			value = 0;
 	}
 }
@@ -1,7 +1,14 @@
 #include "perft.hh"
 #include "uci.hh"
 
+#include "threading/pool.hh"
+#include "threading/thread.hh"
+
+#include "util/compiler.hh" // Must be included after everything else to work
+
+#include <algorithm>
 #include <chrono>
+#include <numeric>
 
 using std::chrono::duration_cast;
 using std::chrono::microseconds;
@@ -11,10 +18,11 @@ using time_point = high_resolution_clock::time_point;
 
 chess::Nodes chess::perft(const Position &position, const Depth depth)
 {
-	MoveList move_list {position};
+	// The position itself is the only node at depth 0
+	if (depth <= 1)
+		return depth ? count_legal_moves(position) : 1;
 
-	if (depth == 1)
-		return move_list.size();
+	const MoveList move_list {position};
 
 	Nodes nodes = 0;
 
@@ -28,45 +36,225 @@ chess::Nodes chess::perft(const Position &position, const Depth depth)
 	return nodes;
 }
 
-chess::Nodes chess::divide(const Position &position, const Depth depth)
+chess::PerftTable::PerftTable(const std::size_t size_in_bytes)
+	: nentries(util::max(size_in_bytes / sizeof(Entry), std::size_t {1})),
+	  entries(new Entry [nentries])
 {
-	MoveList move_list {position};
+	for (std::size_t i = 0; i < nentries; ++i)
+	{
+		entries[i].check.store(0, std::memory_order_relaxed);
+		entries[i].data.store(0, std::memory_order_relaxed);
+	}
+}
 
-	if (depth == 0)
-		return 1;
+bool chess::PerftTable::probe(const Key key, const Depth depth, Nodes &nodes) const
+{
+	const Entry &entry = entries[index(key, depth)];
 
-	Nodes nodes = 0, count;
+	const std::uint64_t data  = entry.data.load(std::memory_order_relaxed);
+	const std::uint64_t check = entry.check.load(std::memory_order_relaxed);
 
-	for (const Move move : move_list)
+	if ((check ^ data) != key || (data & 0xff) != depth)
+		return false;
+
+	nodes = data >> 8;
+	return true;
+}
+
+void chess::PerftTable::save(const Key key, const Depth depth, const Nodes nodes)
+{
+	Entry &entry = entries[index(key, depth)];
+	const std::uint64_t data = (nodes << 8) | depth;
+
+	entry.check.store(key ^ data, std::memory_order_relaxed);
+	entry.data.store(data, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Perft which looks up and stores the node count of every interior node in a table,
+ * so subtrees reached by transposition are only counted once. Leaves are not stored,
+ * counting their moves is cheaper than probing the table.
+ *
+ * @param position
+ * @param depth
+ * @param table
+ * @return Nodes
+ */
+chess::Nodes chess::perft(const Position &position, const Depth depth, PerftTable &table)
+{
+	if (depth <= 1)
+		return depth ? count_legal_moves(position) : 1;
+
+	// The table relies on incrementally updated keys, check them against a fresh position
+	ASSERT(Position {position.fen()}.key() == position.key());
+
+	Nodes nodes = 0;
+
+	if (table.probe(position.key(), depth, nodes))
+		return nodes;
+
+	for (const Move move : MoveList {position})
 	{
 		Position next_position {position};
 		next_position.do_move(move);
+		nodes += perft(next_position, depth - 1, table);
+	}
 
-		count = depth == 1 ? 1 : perft(next_position, depth - 1);
-		nodes += count;
+	table.save(position.key(), depth, nodes);
+	return nodes;
+}
 
-		fmt::print("{}: {}\n", uci::format_move(move), count);
+/**
+ * @brief Perft, split across a thread pool. Each root move becomes a task, unless there are
+ * too few root moves to keep every thread busy, in which case each reply to a root move does.
+ *
+ * @param position
+ * @param depth
+ * @param threads
+ * @param table Table shared by all threads, or nullptr for unhashed perft
+ * @return std::vector<Nodes> Number of leaf nodes below each root move, in move list order.
+ * Empty at depth 0, where no root moves are made.
+ */
+std::vector<chess::Nodes> chess::split_perft(const Position &position, const Depth depth,
+											  const unsigned threads, PerftTable *table)
+{
+	if (depth == 0)
+		return {};
+
+	const MoveList move_list {position};
+	std::vector<Nodes> root_counts(move_list.size());
+
+	if (depth == 1)
+	{
+		std::fill(root_counts.begin(), root_counts.end(), 1);
+		return root_counts;
 	}
 
-	return nodes;
+	struct Task
+	{
+		Position position;
+		Depth depth;
+		std::size_t root_index;
+	};
+
+	const bool split_replies = depth >= 3 && move_list.size() < threads * PerftTasksPerThread;
+
+	std::vector<Task> tasks;
+
+	for (std::size_t i = 0; i < move_list.size(); ++i)
+	{
+		Position child {position};
+		child.do_move(move_list[i]);
+
+		if (!split_replies)
+		{
+			tasks.push_back({child, Depth(depth - 1), i});
+			continue;
+		}
+
+		for (const Move move : MoveList {child})
+		{
+			Position grandchild {child};
+			grandchild.do_move(move);
+			tasks.push_back({grandchild, Depth(depth - 2), i});
+		}
+	}
+
+	// Each task writes to its own slot, the results are summed per root move afterwards
+	std::vector<Nodes> task_counts(tasks.size());
+
+	{
+		threading::ThreadPool pool {threads};
+		threading::TaskGroup group;
+
+		for (std::size_t i = 0; i < tasks.size(); ++i)
+		{
+			pool.submit([&, i]
+			{
+				const Task &task = tasks[i];
+				task_counts[i] = table ? perft(task.position, task.depth, *table)
+									   : perft(task.position, task.depth);
+			}, group);
+		}
+
+		pool.wait(group);
+	}
+
+	for (std::size_t i = 0; i < tasks.size(); ++i)
+		root_counts[tasks[i].root_index] += task_counts[i];
+
+	return root_counts;
+}
+
+chess::Nodes chess::parallel_perft(const Position &position, const Depth depth, const unsigned threads,
+									PerftTable *table)
+{
+	if (depth == 0)
+		return 1;
+
+	const std::vector<Nodes> root_counts = split_perft(position, depth, threads, table);
+	return std::accumulate(root_counts.begin(), root_counts.end(), Nodes {0});
+}
+
+chess::Nodes chess::divide(const Position &position, const Depth depth, const unsigned threads,
+						   PerftTable *table)
+{
+	if (depth == 0)
+		return 1;
+
+	const MoveList move_list {position};
+	const std::vector<Nodes> root_counts = split_perft(position, depth, threads, table);
+
+	for (std::size_t i = 0; i < move_list.size(); ++i)
+		fmt::print("{}: {}\n", uci::format_move(move_list[i]), root_counts[i]);
+
+	return std::accumulate(root_counts.begin(), root_counts.end(), Nodes {0});
 }
 
 int chess::perft(int argc, char *argv[])
 {
 	if (argc < 3)
 	{
-		fmt::print("Usage: {} [perft | divide] [depth] [fen string = startpos]\n", argv[0]);
+		fmt::print("Usage: {} [perft | divide] [depth] [--threads n = {}] [--hash MiB = 0]"
+				   " [fen string = startpos]\n", argv[0], threading::max_threads());
 		return EXIT_FAILURE;
 	}
 	
 	int status = 0;
-	unsigned depth = 0;
+	unsigned depth = 0, threads = threading::max_threads(), hash = 0;
 	std::vector<std::string> parts {argv, argv + argc};
 	std::string fen;
 
-	// Parse FEN
+	// Parse options and FEN
 	for (int i = 3; i < argc; ++i)
-		fen += parts[i] + ' ';
+	{
+		if (parts[i] == "--threads" && i + 1 < argc)
+		{
+			try
+			{
+				threads = util::max(unsigned(std::stoul(parts[++i])), 1u);
+			}
+			catch (const std::exception &e)
+			{
+				fmt::print("Failed to parse thread count: {}\n", e.what());
+				status = EXIT_FAILURE;
+			}
+		}
+		else if (parts[i] == "--hash" && i + 1 < argc)
+		{
+			try
+			{
+				hash = std::stoul(parts[++i]);
+			}
+			catch (const std::exception &e)
+			{
+				fmt::print("Failed to parse hash size: {}\n", e.what());
+				status = EXIT_FAILURE;
+			}
+		}
+		else
+			fen += parts[i] + ' ';
+	}
 
 	fen.empty() ? (void)(fen = fens::Startpos) : fen.pop_back();
 
@@ -97,11 +285,20 @@ int chess::perft(int argc, char *argv[])
 		status = EXIT_FAILURE;
 	}
 
+	if (status != 0)
+		return status;
+
 	const Position position {fen};
 	fmt::print("{}\n", position.to_string());
 
+	std::unique_ptr<PerftTable> table;
+
+	if (hash > 0)
+		table = std::make_unique<PerftTable>(std::size_t(hash) * 1024 * 1024);
+
 	const time_point t0   = high_resolution_clock::now();
-	const Nodes nodes     = parts[1] == "divide" ? divide(position, depth) : perft(position, depth);
+	const Nodes nodes     = parts[1] == "divide" ? divide(position, depth, threads, table.get())
+													 : parallel_perft(position, depth, threads, table.get());
 	const time_point t1   = high_resolution_clock::now();
 	const microseconds dt = duration_cast<microseconds>(t1 - t0);
 
@@ -112,3 +309,136 @@ int chess::perft(int argc, char *argv[])
 
 	return status;
 }
+
+/**
+ * @brief Perft which generates the full move list at the leaves instead of only counting moves,
+ * used to measure move generation throughput.
+ */
+static chess::Nodes generated_perft(const chess::Position &position, const chess::Depth depth)
+{
+	const chess::MoveList move_list {position};
+
+	if (depth == 1)
+		return move_list.size();
+
+	chess::Nodes nodes = 0;
+
+	for (const chess::Move move : move_list)
+	{
+		chess::Position next_position {position};
+		next_position.do_move(move);
+		nodes += generated_perft(next_position, depth - 1);
+	}
+
+	return nodes;
+}
+
+/**
+ * @brief Single-threaded, unhashed perft on a fixed set of positions, reporting move generation
+ * throughput (in millions of leaf nodes per second) for the attack generation backend compiled in.
+ * Leaves are counted both with count_legal_moves and with a full MoveList.
+ * Also times copying a position and applying a move to it, in nanoseconds per move.
+ */
+int chess::perft_bench(int, char *[])
+{
+	struct BenchPosition
+	{
+		const char *name, *fen;
+		Depth depth;
+	};
+
+	static constexpr BenchPosition positions[]
+	{
+		{"Startpos", fens::Startpos, 5},
+		{"Kiwipete", fens::Kiwipete, 4},
+		{"CPW #3",   "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -", 6},
+		{"CPW #4",   "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq -", 4},
+		{"CPW #5",   "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ -", 4}
+	};
+
+	const auto time = [](auto &&f)
+	{
+		const time_point t0 = high_resolution_clock::now();
+		const Nodes nodes   = f();
+		const time_point t1 = high_resolution_clock::now();
+
+		return std::make_pair(nodes, duration_cast<microseconds>(t1 - t0));
+	};
+
+	fmt::print("Attack generation: {}\n", util::attack_generation_info());
+	fmt::print("{: <10} {: <6} {: <12} {: <18} {: <18}\n",
+			   "Name", "Depth", "Nodes", "Counted (Mnps)", "Generated (Mnps)");
+
+	Nodes total_nodes = 0;
+	microseconds total_counted {0}, total_generated {0};
+	int status = EXIT_SUCCESS;
+
+	for (const BenchPosition &bench_position : positions)
+	{
+		const Position position {bench_position.fen};
+		const Depth depth = bench_position.depth;
+
+		const auto [counted_nodes, counted_time]     = time([&] { return perft(position, depth); });
+		const auto [generated_nodes, generated_time] = time([&] { return generated_perft(position, depth); });
+
+		if (counted_nodes != generated_nodes)
+		{
+			fmt::print("{}: node count mismatch ({} counted, {} generated)\n",
+					   bench_position.name, counted_nodes, generated_nodes);
+			status = EXIT_FAILURE;
+		}
+
+		fmt::print("{: <10} {: <6} {: <12} {: <18.2f} {: <18.2f}\n",
+				   bench_position.name, depth, counted_nodes,
+				   double(counted_nodes) / (counted_time.count() + 1),
+				   double(generated_nodes) / (generated_time.count() + 1));
+
+		total_nodes += counted_nodes;
+		total_counted += counted_time;
+		total_generated += generated_time;
+	}
+
+	fmt::print("{: <10} {: <6} {: <12} {: <18.2f} {: <18.2f}\n",
+			   "Total", "", total_nodes,
+			   double(total_nodes) / (total_counted.count() + 1),
+			   double(total_nodes) / (total_generated.count() + 1));
+
+	// Copy-make, as done in search, for every move two plies from the positions above
+	std::vector<std::pair<Position, Move>> moves;
+
+	for (const BenchPosition &bench_position : positions)
+	{
+		const Position position {bench_position.fen};
+
+		for (const Move move : MoveList {position})
+		{
+			Position child {position};
+			child.do_move(move);
+
+			for (const Move reply : MoveList {child})
+				moves.emplace_back(child, reply);
+		}
+	}
+
+	Key checksum = 0;
+
+	const auto [do_moves, do_move_time] = time([&]
+	{
+		for (unsigned i = 0; i < DoMoveBenchPasses; ++i)
+		{
+			for (const auto &[position, move] : moves)
+			{
+				Position next_position {position};
+				next_position.do_move(move);
+				checksum += next_position.key();
+			}
+		}
+
+		return Nodes(moves.size()) * DoMoveBenchPasses;
+	});
+
+	fmt::print("\ndo_move:   {:.1f} ns/move over {} moves (checksum {:016x})\n",
+			   1e3 * do_move_time.count() / do_moves, do_moves, checksum);
+
+	return status;
+}
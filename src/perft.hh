@@ -2,10 +2,61 @@
 
 #include "movegen.hh"
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 namespace chess
 {
+	// Root moves (or replies to root moves) queued per thread, so that
+	// threads which finish early can steal the remaining work
+	constexpr unsigned PerftTasksPerThread = 4;
+
+	// Number of times perftbench applies each move in its do_move micro-benchmark
+	constexpr unsigned DoMoveBenchPasses = 200;
+
+	/**
+	 * @brief Transposition table for perft, mapping a position key and depth to a node count.
+	 * Entries are read and written without locks, so the table can be shared by parallel perft
+	 * threads. The stored key is xored with the data, so an entry torn by a concurrent write
+	 * fails verification and is treated as a miss.
+	 */
+	class PerftTable
+	{
+	private:
+		struct Entry
+		{
+			// Node count in the upper 56 bits, depth in the lower 8
+			std::atomic<std::uint64_t> check, data;
+		};
+
+		std::size_t nentries;
+		std::unique_ptr<Entry []> entries;
+
+		std::size_t index(const Key key, const Depth depth) const
+		{
+			return (key ^ (depth * 0x9e3779b97f4a7c15)) % nentries;
+		}
+
+	public:
+		PerftTable(const std::size_t size_in_bytes);
+
+		std::size_t size_in_bytes() const { return nentries * sizeof(Entry); }
+
+		bool probe(const Key key, const Depth depth, Nodes &nodes) const;
+		void save(const Key key, const Depth depth, const Nodes nodes);
+	};
+
 	extern Nodes perft(const Position &position, const Depth depth);
-	extern Nodes divide(const Position &position, const Depth depth);
+	extern Nodes perft(const Position &position, const Depth depth, PerftTable &table);
+
+	extern std::vector<Nodes> split_perft(const Position &position, const Depth depth,
+										  const unsigned threads, PerftTable *table = nullptr);
+	extern Nodes parallel_perft(const Position &position, const Depth depth, const unsigned threads,
+								PerftTable *table = nullptr);
+	extern Nodes divide(const Position &position, const Depth depth, const unsigned threads,
+						PerftTable *table = nullptr);
 
 	extern int perft(int argc, char *argv[]);
+	extern int perft_bench(int argc, char *argv[]);
 } // chess
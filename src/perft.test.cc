@@ -69,7 +69,7 @@ static PerftData perft_data[]
 	{
 		"Promotions",
 		"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - -",
-		{24, 496, 9483, 182383, 3605103, 71179139}, 6
+		{24, 496, 9483, 182838, 3605103, 71179139}, 6
 	},
 
 	//
@@ -143,6 +143,51 @@ TEST_CASE("Perft", "[perft]")
 	}
 }
 
+TEST_CASE("Parallel perft", "[perft]")
+{
+	// One thread splits at the root, eight threads split the replies to each root move too
+	for (const unsigned threads : {1u, 8u})
+	{
+		for (const PerftData &data : perft_data)
+		{
+			Position position {data.fen};
+
+			for (Depth depth = 1; depth <= util::min(data.depth, Depth(4)); ++depth)
+				REQUIRE(data.counts[depth - 1] == parallel_perft(position, depth, threads));
+		}
+	}
+}
+
+TEST_CASE("Hashed perft", "[perft]")
+{
+	// Small enough that entries are overwritten often, and reused across positions and depths
+	PerftTable table {1024 * 1024};
+
+	for (const PerftData &data : perft_data)
+	{
+		Position position {data.fen};
+
+		for (Depth depth = 1; depth <= util::min(data.depth, Depth(5)); ++depth)
+			REQUIRE(data.counts[depth - 1] == parallel_perft(position, depth, 2, &table));
+	}
+}
+
+TEST_CASE("Perft at depth 0", "[perft]")
+{
+	PerftTable table {1024 * 1024};
+
+	// The root is the only node, and no root moves are made
+	for (const PerftData &data : perft_data)
+	{
+		Position position {data.fen};
+
+		REQUIRE(perft(position, 0) == 1);
+		REQUIRE(perft(position, 0, table) == 1);
+		REQUIRE(parallel_perft(position, 0, 2) == 1);
+		REQUIRE(split_perft(position, 0, 2).empty());
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	bitboards::init();
@@ -16,12 +16,16 @@ void Position::clear()
 	for (Bitboard &bb : _types)
 		bb = 0;
 
+	_board.fill(Piece::Invalid);
+
 	_side = Colour::White;
 	_plies = _rule50 = 0;
 	_castling = Castling::None;
 	_en_passant = Square::Invalid;
 	_checkers = _pinned = _blockers = 0;
 	_key = 0;
+	_pawn_key = zobrist.no_pawns;
+	_material_key = 0;
 
 #if defined(CRAZYHOUSE)
 	_crazyhouse = false;
@@ -40,7 +44,29 @@ void Position::clear()
  */
 bool Position::is_ok() const
 {
-	return true;
+	Key pawn_key = zobrist.no_pawns, material_key = 0;
+	util::array_t<unsigned, Pieces> counts {};
+
+	// The mailbox and incrementally updated keys must agree with the bitboards
+	for (Square sq = Square::A1; sq <= Square::H8; ++sq)
+	{
+		const Piece piece = _board[util::underlying_value(sq)];
+
+		if (is_valid(piece) ? !(occupied(piece) & sq) : !is_empty(sq))
+			return false;
+
+		if (!is_valid(piece))
+			continue;
+
+		const auto i = util::underlying_value(piece);
+
+		if (type_of(piece) == PieceType::Pawn)
+			pawn_key ^= zobrist.piece_square[i][util::underlying_value(sq)];
+
+		material_key ^= zobrist.material[i][counts[i]++];
+	}
+
+	return pawn_key == _pawn_key && material_key == _material_key;
 }
 
 /**
@@ -450,10 +476,19 @@ void Position::set_piece(const Square sq, const Piece piece, bool promoted_pawn)
 	(void)promoted_pawn;
 #endif
 
+	// Material keys are indexed by the number of pieces of this kind before it is placed
+	_material_key ^= zobrist.material[util::underlying_value(piece)][count(piece)];
+
 	_types  [util::underlying_value(type_of(piece))]   |= sq;
 	_colours[util::underlying_value(colour_of(piece))] |= sq;
+	_board  [util::underlying_value(sq)] = piece;
+
+	const Key key = zobrist.piece_square[util::underlying_value(piece)][util::underlying_value(sq)];
 
-	_key ^= zobrist.piece_square[util::underlying_value(piece)][util::underlying_value(sq)];
+	_key ^= key;
+
+	if (type_of(piece) == PieceType::Pawn)
+		_pawn_key ^= key;
 }
 
 /**
@@ -488,8 +523,16 @@ void Position::remove_piece(const Square sq, const Piece piece)
 #endif
 	_types  [util::underlying_value(type_of(piece))]   ^= sq;
 	_colours[util::underlying_value(colour_of(piece))] ^= sq;
+	_board  [util::underlying_value(sq)] = Piece::Invalid;
+
+	_material_key ^= zobrist.material[util::underlying_value(piece)][count(piece)];
 
-	_key ^= zobrist.piece_square[util::underlying_value(piece)][util::underlying_value(sq)];
+	const Key key = zobrist.piece_square[util::underlying_value(piece)][util::underlying_value(sq)];
+
+	_key ^= key;
+
+	if (type_of(piece) == PieceType::Pawn)
+		_pawn_key ^= key;
 }
 
 void Position::move_piece(const Square from, const Square to, const Piece piece)
@@ -507,9 +550,16 @@ void Position::move_piece(const Square from, const Square to, const Piece piece)
 
 	_types  [util::underlying_value(type_of(piece))]   ^= mask;
 	_colours[util::underlying_value(colour_of(piece))] ^= mask;
+	_board  [util::underlying_value(from)] = Piece::Invalid;
+	_board  [util::underlying_value(to)]   = piece;
+
+	const Key key = zobrist.piece_square[util::underlying_value(piece)][util::underlying_value(from)]
+				  ^ zobrist.piece_square[util::underlying_value(piece)][util::underlying_value(to)];
+
+	_key ^= key;
 
-	_key ^= zobrist.piece_square[util::underlying_value(piece)][util::underlying_value(from)];
-	_key ^= zobrist.piece_square[util::underlying_value(piece)][util::underlying_value(to)];
+	if (type_of(piece) == PieceType::Pawn)
+		_pawn_key ^= key;
 }
 
 /**
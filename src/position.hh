@@ -18,7 +18,10 @@ namespace chess
 		util::array_t<Bitboard, Colours> _colours;
 		util::array_t<Bitboard, PieceTypes> _types;
 
-		Key _key;
+		// Piece on each square (Piece::Invalid if empty), kept in sync with the bitboards
+		util::array_t<Piece, Squares> _board;
+
+		Key _key, _pawn_key, _material_key;
 
 		Counter _rule50;
 		Square _en_passant;
@@ -129,6 +132,7 @@ namespace chess
 
 		Key key() const;
 		Key pawn_key() const;
+		Key material_key() const;
 
 		////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -192,7 +196,8 @@ namespace chess
 	};
 
 	inline Position::Position()
-		: _colours(), _types(), _key(), _rule50(),
+		: _colours(), _types(), _board(), _key(), _pawn_key(zobrist.no_pawns), _material_key(),
+		  _rule50(),
 		  _en_passant(Square::Invalid), _castling(),
 		  _side(), _checkers(), _pinned(), _blockers(),
 #if defined(CRAZYHOUSE)
@@ -200,6 +205,7 @@ namespace chess
 #endif
 		  _plies()
 	{
+		_board.fill(Piece::Invalid);
 	}
 
 	inline Position::Position(const std::string &fen)
@@ -219,19 +225,15 @@ namespace chess
 	{
 		ASSERT(is_valid(sq));
 
-		using PT = PieceType;
-		for (PT type : {PT::Pawn, PT::Knight, PT::Bishop, PT::Rook, PT::Queen, PT::King})
-			if (occupied(type) & sq)
-				return type;
-
-		return PT::Invalid;
+		// PieceType::Invalid for empty squares
+		return type_of(_board[util::underlying_value(sq)]);
 	}
 
 	inline Piece Position::piece_on(const Square sq) const
 	{
 		ASSERT(!is_empty(sq));
 
-		return make_piece(colour_of_piece_on(sq), type_of_piece_on(sq));
+		return _board[util::underlying_value(sq)];
 	}
 
 	inline bool Position::is_empty(const Square sq) const
@@ -552,10 +554,12 @@ namespace chess
 
 	inline Key Position::pawn_key() const
 	{
-		Key k = 1442695040888963407;
-		k = k * 6364136223846793005 + occupied(Piece::WhitePawn);
-		k = k * 6364136223846793005 + occupied(Piece::BlackPawn);
-		return k;
+		return _pawn_key;
+	}
+
+	inline Key Position::material_key() const
+	{
+		return _material_key;
 	}
 
 	inline Bitboard Position::checkers() const
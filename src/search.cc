@@ -6,12 +6,133 @@
 using namespace chess;
 using namespace chess::search;
 
-Thread::Thread(std::size_t id)
-	: threading::Thread(id), root_position(), limits(),
-	  id_depth(), sel_depth(), nodes(), qnodes(),
-	  pawn_cache(std::make_unique<pawns::Cache>()),
-	  heuristics(), root_pv(), root_value(-Infinite)
+/**
+ * @brief Shared hint that a node near the root is currently being searched by some thread.
+ * When a thread reaches a node that another thread is already searching, it reduces late moves
+ * further so that it moves on to other parts of the tree sooner, and the threads diverge.
+ */
+struct Breadcrumb
+{
+	std::atomic<const Thread *> thread;
+	std::atomic<Key> key;
+};
+
+constexpr std::size_t Breadcrumbs = 1024;
+constexpr Depth BreadcrumbPlies = 8;
+
+static util::array_t<Breadcrumb, Breadcrumbs> breadcrumbs;
+
+/**
+ * @brief ABDADA: hash table of moves (identified by the key of the resulting position)
+ * which are currently being searched by some thread. Collisions only cause a move to be
+ * deferred or searched unnecessarily, so no locking is needed.
+ */
+static util::array_t<std::atomic<Key>, ABDADATableSize> currently_searching;
+
+static bool is_being_searched(const Key move_key)
 {
+	return currently_searching[move_key & (ABDADATableSize - 1)].load(std::memory_order_relaxed)
+		== move_key;
+}
+
+/**
+ * @brief Marks a move as being searched on construction, and unmarks it on destruction
+ */
+class SearchingGuard
+{
+private:
+	std::atomic<Key> *slot;
+	Key move_key;
+
+public:
+	SearchingGuard(const Key move_key, const bool enabled)
+		: slot(nullptr), move_key(move_key)
+	{
+		if (!enabled)
+			return;
+
+		slot = &currently_searching[move_key & (ABDADATableSize - 1)];
+		slot->store(move_key, std::memory_order_relaxed);
+	}
+
+	~SearchingGuard()
+	{
+		Key expected = move_key;
+
+		// Another thread may have reused the slot meanwhile, leave it alone if so
+		if (slot)
+			slot->compare_exchange_strong(expected, 0, std::memory_order_relaxed);
+	}
+};
+
+/**
+ * @brief Leaves a breadcrumb on construction (if the slot is free), and removes it on destruction
+ */
+class BreadcrumbGuard
+{
+private:
+	Breadcrumb *breadcrumb;
+	bool owner, searched_by_other_thread;
+
+public:
+	BreadcrumbGuard(const Thread *thread, const Key key, const Depth plies_to_root)
+		: breadcrumb(nullptr), owner(false), searched_by_other_thread(false)
+	{
+		if (plies_to_root >= BreadcrumbPlies)
+			return;
+
+		breadcrumb = &breadcrumbs[key % Breadcrumbs];
+
+		const Thread *other = breadcrumb->thread.load(std::memory_order_relaxed);
+
+		if (!other)
+		{
+			breadcrumb->thread.store(thread, std::memory_order_relaxed);
+			breadcrumb->key.store(key, std::memory_order_relaxed);
+			owner = true;
+		}
+		else
+			searched_by_other_thread = other != thread
+				&& breadcrumb->key.load(std::memory_order_relaxed) == key;
+	}
+
+	~BreadcrumbGuard()
+	{
+		if (owner)
+			breadcrumb->thread.store(nullptr, std::memory_order_relaxed);
+	}
+
+	bool is_searched_by_other_thread() const { return searched_by_other_thread; }
+};
+
+Thread::Thread(std::size_t id, threading::ThreadPool *pool, std::size_t worker)
+	: threading::Thread(id, pool, worker), root_position(), limits(), parallel_search(ParallelSearch::LazySMP),
+	  table(&tt),
+	  id_depth(), sel_depth(), completed_depth(), nodes(), qnodes(),
+	  pawn_cache(),
+	  heuristics(), root_pv(), root_value(-Infinite),
+	  root_lines(), excluded_moves(), multipv(1), pv_index(0)
+{
+}
+
+/**
+ * @brief Checks for the stop signal, and stops the search once the node limit is reached.
+ * As with the time limit, the first iteration is always completed so that there is a move to play.
+ *
+ * @param total_nodes_searched
+ * @return true if the search should return immediately
+ */
+bool Thread::should_abort(const Nodes total_nodes_searched)
+{
+	if (limits.nodes && total_nodes_searched >= limits.nodes && !root_pv.empty() && !should_stop())
+	{
+		if (is_main_thread())
+			static_cast<MainThread *>(this)->stop_thinking_on_time();
+		else
+			stop_thinking();
+	}
+
+	return should_stop();
 }
 
 /**
@@ -30,7 +151,7 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 	const Nodes total_nodes_searched = nodes_searched() + qnodes_searched();
 
 	// Check for stop signal or if we've reached the node limit
-	if (should_stop() || (limits.nodes && total_nodes_searched >= limits.nodes))
+	if (should_abort(total_nodes_searched))
 	{
 		// If we are in check, the position is probably dangerous. Return draw value instead.
 		return position.checkers() ? Draw : eval::evaluate(position, pawn_cache.get());
@@ -41,7 +162,9 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 
 	// Check for draw by fifty moves / threefold repetition
 	// The value we return here is Draw ± 1, which solves an issue with threefold blindness.
-	if (position.is_draw_by_rule50() || std::count(key_history.begin(), key_history.end(), key) >= 3)
+	// The root is always searched, as we need a move to play even if the game is already drawn.
+	if (plies_to_root > 0 && (position.is_draw_by_rule50()
+						   || std::count(key_history.begin(), key_history.end(), key) >= 3))
 		return (total_nodes_searched & 3) - 1;
 
 	// Update selective depth
@@ -53,13 +176,13 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 	// At root node, make sure we try the best move from the previous iteration first
 	if (plies_to_root == 0)
 	{
-		if (!root_pv.empty())
-			hash_move = root_pv[0];
+		if (pv_index < root_lines.size())
+			hash_move = root_lines[pv_index].pv[0];
 	}
 	// Probe transposition table at non-root nodes
 	else
 	{
-		const Entry *entry = tt.probe(key);
+		const Entry *entry = table->probe(key);
 
 		if (entry)
 		{
@@ -77,12 +200,14 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 				if (is_mate(value))
 					value = absolute_mate_value(value, plies_to_root);
 
+				// Fail-soft: return the stored value itself rather than alpha/beta,
+				// so that the caller receives the tightest bound we know of.
 				if (bound == Bound::Exact)
 					return value;
 				else if (bound == Bound::Upper && value <= alpha)
-					return alpha;
+					return value;
 				else if (bound == Bound::Lower && value >= beta)
-					return beta;
+					return value;
 			}
 
 			hash_move = entry->move;
@@ -100,18 +225,31 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 	if (move_list.size() == 0)
 		return position.checkers() ? mated_in(plies_to_root) : Draw; 
 
+	// Let other threads know we are searching this node, and check if another thread already is
+	const BreadcrumbGuard breadcrumb {this, key, plies_to_root};
+
 	// Move ordering
 	evaluate_move_list(position, move_list, depth, hash_move, heuristics);
 
 	Bound bound = Bound::Upper;
-	Value value;
+	Value value, best_value = -Infinite;
 	Move best_move;
 	MoveSequence child_pv;
 
+	// ABDADA: moves deferred because another thread was searching them, these are
+	// searched after all other moves, by which time the other thread has likely finished.
+	const bool abdada = parallel_search == ParallelSearch::ABDADA && depth >= ABDADADeferDepth;
+	util::array_t<Move, MaxMoves> deferred_moves;
+	unsigned deferred = 0, next_deferred = 0;
+
 	// Search each move
-	for (unsigned move_number = 0; move_number < move_list.size(); ++move_number)
+	for (unsigned move_number = 0; move_number < move_list.size() + deferred; ++move_number)
 	{
-		const Move move = move_list.select();
+		const bool is_deferred = move_number >= move_list.size();
+		const Move move = is_deferred ? deferred_moves[next_deferred++] : move_list.select();
+
+		if (plies_to_root == 0 && is_excluded_root_move(move))
+			continue;
 
 		const Piece moved_piece = position.moved_piece(move);
 		const bool is_capture = position.is_capture(move);
@@ -120,6 +258,16 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 		// Make a copy, apply the move, store new key in key stack, and increment nodes counter
 		Position next_position {position};
 		next_position.do_move(move);
+
+		// Always search the first move ourselves, as the remaining moves depend on its result
+		if (abdada && move_number > 0 && !is_deferred && is_being_searched(next_position.key()))
+		{
+			deferred_moves[deferred++] = move;
+			continue;
+		}
+
+		const SearchingGuard searching {next_position.key(), abdada};
+
 		key_history.push_back(next_position.key());
 		nodes.fetch_add(1, std::memory_order_relaxed);
 
@@ -139,6 +287,10 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 
 				// Reduce further if the move has a bad history
 				r += heuristics.history.probe(moved_piece, move.to()) < 0;
+
+				// Reduce further if another thread is already searching this node
+				r += parallel_search == ParallelSearch::LazySMP
+					&& breadcrumb.is_searched_by_other_thread();
 			}
 
 			r = util::clamp(r, 1, depth);
@@ -162,6 +314,9 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 		// Undo
 		key_history.pop_back();
 
+		// Keep track of the best value, even if it doesn't improve alpha (fail-soft)
+		best_value = util::max(best_value, value);
+
 		// Check if we have a new best value
 		if (value > alpha)
 		{
@@ -191,11 +346,12 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 				if (!is_capture && !is_promotion)
 					heuristics.killer.update(depth, move);
 
-				// Save to transposition table
-				tt.save(key, depth, plies_to_root, beta, bound, best_move);
+				// Save to transposition table, unless some root moves were excluded
+				if (may_save_result(plies_to_root))
+					table->save(key, depth, plies_to_root, best_value, bound, best_move);
 
-				// Fail-hard beta-cutoff
-				return beta;
+				// Fail-soft beta-cutoff
+				return best_value;
 			}
 		}
 		else
@@ -209,10 +365,45 @@ Value Thread::search(const Position &position, Value alpha, Value beta, const De
 		}
 	}
 
-	// Save to transposition table
-	tt.save(key, depth, plies_to_root, alpha, bound, best_move);
+	// Save to transposition table. If no move improved alpha, best_value is an upper bound.
+	// The result for the root isn't saved if some root moves were excluded, as it would be wrong.
+	if (may_save_result(plies_to_root))
+		table->save(key, depth, plies_to_root, best_value, bound, best_move);
 
-	return alpha;
+	return best_value;
+}
+
+/**
+ * @brief Whether a root move must be skipped, either because it is the first move
+ * of a line already found (MultiPV), or because the search is restricted to other
+ * moves (go searchmoves)
+ *
+ * @param move
+ * @return true
+ * @return false
+ */
+bool Thread::is_excluded_root_move(const Move move) const
+{
+	const auto contains = [&] (const MoveSequence &moves)
+	{
+		return std::find(moves.begin(), moves.end(), move) != moves.end();
+	};
+
+	return contains(excluded_moves) || (!limits.searchmoves.empty() && !contains(limits.searchmoves));
+}
+
+/**
+ * @brief Whether the result of a node may be saved to the transposition table. The result
+ * for the root is only valid for the moves searched, so it isn't saved if any root move
+ * was excluded (MultiPV or go searchmoves).
+ *
+ * @param plies_to_root
+ * @return true
+ * @return false
+ */
+bool Thread::may_save_result(const Depth plies_to_root) const
+{
+	return plies_to_root > 0 || (excluded_moves.empty() && limits.searchmoves.empty());
 }
 
 /**
@@ -235,7 +426,7 @@ Value Thread::qsearch(const Position &position, Value alpha, Value beta,
 		static_cast<MainThread *>(this)->check_time_fast();
 
 	// Check for stop signal or if we've reached the node limit
-	if (should_stop() || (limits.nodes && total_nodes_searched >= limits.nodes))
+	if (should_abort(total_nodes_searched))
 	{
 		// If we are in check, the position is probably dangerous. Return draw value instead.
 		return position.checkers() ? Draw : eval::evaluate(position, pawn_cache.get());
@@ -256,14 +447,19 @@ Value Thread::qsearch(const Position &position, Value alpha, Value beta,
 	if (move_list.size() == 0)
 		return position.checkers() ? mated_in(plies_to_root) : Draw; 
 
+	// Best value found so far. When in check every evasion is searched,
+	// so this will always be overwritten by at least one move.
+	Value best_value = -Infinite;
+
 	// "stand pat" evaluation
 	if (!position.checkers())
 	{
 		const Value stand_pat = eval::evaluate(position, pawn_cache.get());
 
 		if (stand_pat >= beta)
-			return beta;
+			return stand_pat;
 
+		best_value = stand_pat;
 		alpha = util::max(alpha, stand_pat);
 	}
 
@@ -309,6 +505,8 @@ Value Thread::qsearch(const Position &position, Value alpha, Value beta,
 		// Undo
 		key_history.pop_back();
 
+		best_value = util::max(best_value, value);
+
 		// Check if we have a new best value
 		if (value > alpha)
 		{
@@ -324,65 +522,206 @@ Value Thread::qsearch(const Position &position, Value alpha, Value beta,
 			// Check for beta cutoff
 			if (alpha >= beta)
 			{
-				// Fail-hard beta-cutoff
-				return beta;
+				// Fail-soft beta-cutoff
+				return best_value;
 			}
 		}
 	}
 
-	return alpha;
+	return best_value;
+}
+
+/**
+ * @brief Searches the root position to the current depth, with an aspiration window
+ * around the score of the same line from the previous iteration.
+ *
+ * @param previous_value Score from the previous iteration, or -Infinite if there isn't one
+ * @param pv
+ * @return Value
+ */
+Value Thread::aspiration_search(const Value previous_value, MoveSequence &pv)
+{
+	Value alpha = -Infinite, beta = Infinite;
+	Value value = -Infinite;
+
+	// Aspiration window statistics for this iteration
+	unsigned fail_lows = 0, fail_highs = 0;
+
+	// Consecutive fail-highs, used to reduce the depth of repeated re-searches
+	unsigned fail_high_streak = 0;
+
+	// Half-width of the aspiration window, grows exponentially on each re-search
+	int delta = AspirationWindowDelta;
+
+	if (id_depth > 1 && previous_value != -Infinite)
+	{
+		const int centre = parallel_search == ParallelSearch::LazySMP
+			? previous_value + AspirationCentreOffsets[id() % AspirationCentreOffsets.size()]
+			: previous_value;
+
+		alpha = util::max(centre - delta, -Infinite);
+		beta  = util::min(centre + delta,  Infinite);
+	}
+
+	// Aspiration loop
+	while (!should_stop())
+	{
+		// Repeated fail-highs are re-searched at a slightly reduced depth,
+		// as a score that keeps rising is usually resolved by a shallower search.
+		const unsigned reduction = fail_high_streak > 1 ? fail_high_streak - 1 : 0;
+
+		pv.clear();
+		value = search(root_position, alpha, beta,
+					   id_depth - util::min(reduction, id_depth - 1u), 0, pv);
+
+		if (should_stop())
+			break;
+
+		const bool fail_low = value <= alpha, fail_high = value >= beta;
+		if (!fail_low && !fail_high)
+			break;
+
+		if (is_main_thread()
+			&& static_cast<MainThread *>(this)->total_search_time() >= BoundInfoDelay)
+		{
+			uci::message(
+				"info depth {:d} seldepth {:d} score {} {}",
+				id_depth, sel_depth, uci::format_value(value),
+				fail_low ? "upperbound" : "lowerbound"
+			);
+		}
+
+		// As the search is fail-soft, value is a bound on the true score
+		// and so the new window can be placed around it, not around the old window.
+
+		// Fail-low: widen downwards and pull beta towards alpha
+		if (fail_low)
+		{
+			beta  = (alpha + beta) / 2;
+			alpha = util::max(value - delta, -Infinite);
+
+			++fail_lows;
+			fail_high_streak = 0;
+		}
+		// Fail-high: widen upwards only
+		else
+		{
+			beta = util::min(value + delta, Infinite);
+
+			++fail_highs;
+			++fail_high_streak;
+		}
+
+		// Give up on the aspiration window if the score is swinging wildly
+		delta += delta / 2;
+		if (delta > AspirationWindowMaxDelta)
+		{
+			alpha = -Infinite;
+			beta  = Infinite;
+		}
+	}
+
+#if defined(NDEBUG)
+	const bool report = is_main_thread();
+#else
+	const bool report = true;
+#endif
+
+	if (report && !should_stop() && (fail_lows || fail_highs))
+	{
+		uci::message(
+			"info string depth {:d} thread {} aspiration faillow {} failhigh {} delta {}",
+			id_depth, id(), fail_lows, fail_highs, delta
+		);
+	}
+
+	return value;
 }
 
 /**
  * @brief Iterative deepening loop.
  * Calls search() repeatedly with increasing depth until times up or stop_thinking() is called.
+ * With MultiPV, each iteration searches the root once per line, excluding the first moves
+ * of the lines already found, so later lines are cheap thanks to the shared TT.
  */
 void Thread::think()
 {
+	if (!pawn_cache)
+		pawn_cache = std::make_unique<pawns::Cache>();
+
 	clear();
 
-	Value alpha = -Infinite, beta = Infinite;
-	Value value = -Infinite;
-	MoveSequence pv;
+	MoveList root_moves {root_position};
+
+	// Ignore searchmoves if none of them are legal
+	if (std::none_of(root_moves.begin(), root_moves.end(),
+					 [&] (const Move move) { return !is_excluded_root_move(move); }))
+		limits.searchmoves.clear();
+
+	const std::size_t searched_root_moves = std::count_if(root_moves.begin(), root_moves.end(),
+		[&] (const Move move) { return !is_excluded_root_move(move); });
+
+	const std::size_t lines = util::min(multipv, searched_root_moves);
+
+	std::vector<RootLine> new_lines;
 
 	// Iterative deepening loop
-	for (id_depth = 1; (!limits.depth || id_depth <= limits.depth) || limits.infinite; ++id_depth)
+	for (id_depth = 1; id_depth < MaxDepth
+					&& ((!limits.depth || id_depth <= limits.depth) || limits.infinite); ++id_depth)
 	{
-		sel_depth = 0;
-
-		if (id_depth > 1)
+		// Lazy SMP helper threads skip some depths, according to their skip schedule
+		if (!is_main_thread() && parallel_search == ParallelSearch::LazySMP)
 		{
-			alpha = util::max(value - AspirationWindowHalfWidth, -Infinite);
-			beta  = util::min(value + AspirationWindowHalfWidth,  Infinite);
+			const std::size_t i = (id() - 1) % SkipSchedules;
+
+			if (((id_depth + SkipPhase[i]) / SkipSize[i]) % 2)
+				continue;
 		}
 
-		// Aspiration loop
-		while (!should_stop())
+		sel_depth = 0;
+		new_lines.clear();
+		excluded_moves.clear();
+
+		for (pv_index = 0; pv_index < lines && !should_stop(); ++pv_index)
 		{
-			pv.clear();
-			value = search(root_position, alpha, beta, id_depth, 0, pv);
-
-			// Fail-low
-			if (value <= alpha)
-				alpha = util::max(value - AspirationWindowHalfWidth, -Infinite);
-			// Fail-high
-			else if (value >= beta)
-				beta = util::min(value + AspirationWindowHalfWidth, Infinite);
-			else
+			const Value previous_value = pv_index < root_lines.size() ? root_lines[pv_index].value
+																	  : -Infinite;
+			MoveSequence pv;
+			const Value value = aspiration_search(previous_value, pv);
+
+			if (should_stop() || pv.empty())
 				break;
+
+			new_lines.push_back({pv, value});
+			excluded_moves.push_back(pv[0]);
 		}
 
-		// If search was stopped prematurely, don't update the root PV / value / depth.
-		if (!should_stop())
+		excluded_moves.clear();
+
+		// If search was stopped prematurely, or no line was found, don't update
+		// the root PV / value / depth, and keep the result of the previous iteration.
+		if (!should_stop() && !new_lines.empty())
 		{
-			root_pv = pv;
-			root_value = value;
+			std::stable_sort(new_lines.begin(), new_lines.end(),
+							 [] (const RootLine &a, const RootLine &b) { return a.value > b.value; });
 
-			uci::message(
-				"info depth {:d} seldepth {:d} thread {} score {} pv {}",
-				id_depth, sel_depth, id(), uci::format_value(root_value),
-				uci::format_variation(root_pv)
-			);
+			root_lines = new_lines;
+			root_pv = root_lines[0].pv;
+			root_value = root_lines[0].value;
+			completed_depth = id_depth;
+
+#if defined(NDEBUG)
+			// Only the main thread reports its progress, the GUI can't tell the threads apart
+			if (is_main_thread())
+#endif
+			for (std::size_t i = 0; i < root_lines.size(); ++i)
+			{
+				uci::message(
+					"info depth {:d} seldepth {:d} thread {} {}score {} pv {}",
+					id_depth, sel_depth, id(), multipv > 1 ? fmt::format("multipv {} ", i + 1) : "",
+					uci::format_value(root_lines[i].value), uci::format_variation(root_lines[i].pv)
+				);
+			}
 
 #if !defined(NDEBUG)
 			uci::message(
@@ -397,7 +736,15 @@ void Thread::think()
 				MainThread *main_thread = static_cast<MainThread *>(this);
 
 				main_thread->post_statistics();
+
+				main_thread->post_iteration();
+
 				main_thread->check_time_slow();
+
+				// go mate: stop once we have proven a mate within the requested number of moves
+				if (limits.mate && root_value > 0 && is_mate(root_value)
+					&& (depth_to_mate(root_value) + 1) / 2 <= limits.mate)
+					break;
 			}
 		}
 		else
@@ -419,6 +766,7 @@ void MainThread::think()
 	{
 		const bool checkmate = root_position.checkers();
 		uci::message("info depth 0 score {}", uci::format_value(checkmate ? Mated : Draw));
+		wait_for_stop_or_ponderhit();
 		uci::message("bestmove {}", uci::format_move({}));
 		return;
 	}
@@ -427,17 +775,25 @@ void MainThread::think()
 	else if (root_moves.size() == 1 && !limits.tc.is_nonzero())
 	{
 		uci::message("info depth 0 score {}", uci::format_value(Draw));
+		wait_for_stop_or_ponderhit();
 		uci::message("bestmove {}", uci::format_move(*root_moves.begin()));
 		return;
 	}
 
 	// todo: this isn't actually implemented yet, an always-replace strategy is used
 	// Increment transposition table epoch, so old entries are immediately overwritten
-	tt.increment_epoch();
+	table->increment_epoch();
 
-	// Set search start time
+	// Set search start time and allocate time for this move.
+	// When pondering, the time manager is only consulted once we receive ponderhit,
+	// and the time spent pondering counts towards the time used for this move.
 	times_up = false;
-	t0 = t1 = high_resolution_clock::now();
+	t0 = t1 = last_statistics = high_resolution_clock::now();
+	time_manager.init(limits.infinite ? TimeControl {} : limits.tc, root_position.side_to_move(), t0);
+
+	best_move_changes = 0;
+	previous_best_move = Move {};
+	previous_value = -Infinite;
 
 	// Start helper threads
 	for (auto &thread : helpers)
@@ -446,31 +802,19 @@ void MainThread::think()
 	// Enter iterative deepening loop
 	Thread::think();
 
-	// Stop helper threads if time's up
-	if (times_up)
-	{
-		for (auto &thread : helpers)
-			thread->stop_thinking();
-	}
-	// If search is infinite, wait until GUI sends stop command
-	else if (limits.infinite)
-	{
-		while (!should_stop()) {};
+	// If search is infinite or we are still pondering, wait until GUI sends stop/ponderhit
+	if (!should_stop())
+		wait_for_stop_or_ponderhit();
 
-		for (auto &thread : helpers)
-			thread->stop_thinking();
-	}
+	// The search is over once the main thread has finished, so stop the helper threads
+	for (auto &thread : helpers)
+		thread->stop_thinking();
 
 	// Wait for helper threads to finish
 	for (auto &thread : helpers)
 		thread->wait_until_idle();
 
-	// Determine best thread
-	Thread *best_thread = this;
-
-	for (auto &thread : helpers)
-		if (thread->depth_reached() > best_thread->depth_reached())
-			best_thread = thread.get();
+	const Thread *best_thread = select_best_thread();
 
 	MoveSequence pv = best_thread->principal_variation();
 	Value value = best_thread->best_value();
@@ -479,6 +823,8 @@ void MainThread::think()
 	if (pv.empty())
 		pv.emplace_back(); // Send null move
 
+	post_statistics(true);
+
 	uci::message(
 		"info depth {:d} thread {} score {} pv {}",
 		depth, best_thread->id(), uci::format_value(value), uci::format_variation(pv)
@@ -488,55 +834,200 @@ void MainThread::think()
 		uci::message("bestmove {} ponder {}", uci::format_move(pv[0]), uci::format_move(pv[1]));
 	else
 		uci::message("bestmove {}", uci::format_move(pv[0]));
+
+#if !defined(NDEBUG)
+	post_memory_usage();
+#endif
 }
 
 /**
- * @brief Called inside search() and qsearch() every so often. Calls stop_thinking() if time's up.
+ * @brief Chooses the thread whose result is reported to the GUI. Each thread votes for
+ * the first move of its principal variation, with a weight proportional to the depth it
+ * completed and to how far its score is above the lowest score among all threads.
+ * The thread with the most votes for its move wins, so a move found by several threads
+ * is preferred over a single thread which happened to search slightly deeper.
+ *
+ * Only completed iterations are taken into account, an iteration which was interrupted
+ * leaves the thread's previous result (and depth) untouched.
+ *
+ * @return const Thread*
  */
-void MainThread::check_time_fast()
+const Thread *MainThread::select_best_thread() const
 {
-	const Colour us = root_position.side_to_move();
-	const milliseconds elapsed = total_search_time();
-	const milliseconds our_time = limits.tc.time(us);
+	std::vector<const Thread *> threads {this};
 
-	// Check movetime
-	if (limits.tc.movetime != limits.tc.movetime.zero() &&
-		elapsed >= (limits.tc.movetime - Overhead))
+	for (auto &thread : helpers)
+		if (!thread->principal_variation().empty())
+			threads.push_back(thread.get());
+
+	Value min_value = Infinite;
+	for (const Thread *thread : threads)
+		min_value = util::min(min_value, thread->best_value());
+
+	const auto votes = [&] (const Thread *voted)
 	{
-		times_up = true;
-		stop_thinking();
-	}
+		long long total = 0;
+
+		for (const Thread *thread : threads)
+			if (thread->principal_variation()[0] == voted->principal_variation()[0])
+				total += (thread->best_value() - min_value + VoteScoreMargin) * thread->depth_reached();
 
-	// Check wtime/btime
-	if (our_time != our_time.zero() && elapsed > (our_time - Overhead) / 10)
+		return total;
+	};
+
+	// The main thread may not have completed an iteration if it was stopped very early
+	const Thread *best_thread = threads[0];
+	if (best_thread->principal_variation().empty())
+		return threads.size() > 1 ? threads[1] : best_thread;
+
+	long long best_votes = votes(best_thread);
+
+	for (const Thread *thread : threads)
 	{
-		times_up = true;
-		stop_thinking();
+		const long long thread_votes = votes(thread);
+
+		// Once a mate has been found, prefer the shortest mate (or the longest defence)
+		if (is_mate(best_thread->best_value()))
+		{
+			if (thread->best_value() > best_thread->best_value())
+				best_thread = thread, best_votes = thread_votes;
+		}
+		else if ((is_mate(thread->best_value()) && thread->best_value() > 0)
+			  || thread_votes > best_votes)
+			best_thread = thread, best_votes = thread_votes;
 	}
+
+	return best_thread;
 }
 
 /**
- * @brief Called after each search iteration. Calls stop_thinking() if time's up.
+ * @brief Called inside search() and qsearch() every so often.
+ * Calls stop_thinking() if we have reached the maximum time allocated for this move.
+ */
+void MainThread::check_time_fast()
+{
+	// Always complete the first iteration, so that we have a move to play
+	if (!time_manager.is_enabled() || principal_variation().empty())
+		return;
+
+	if (time_manager.elapsed() >= time_manager.maximum_time())
+		stop_thinking_on_time();
+}
+
+/**
+ * @brief Called after each search iteration. Calls stop_thinking() if we have used the
+ * optimum time (extended if the best move is unstable), or if there isn't enough time
+ * left to complete another iteration.
  */
 void MainThread::check_time_slow()
 {
+	const time_point now = high_resolution_clock::now();
+	const milliseconds last_iteration_time = duration_cast<milliseconds>(now - t1);
+	t1 = now;
+
+	const Move best_move = principal_variation().empty() ? Move {} : principal_variation()[0];
+	const Value value = best_value();
+
+	// Decay the number of best move changes, so that recent changes carry more weight
+	best_move_changes /= 2;
+	if (previous_best_move.is_valid() && best_move != previous_best_move)
+		best_move_changes += 1;
+
+	if (!time_manager.can_start_iteration(last_iteration_time, best_move_changes,
+										  previous_value, value))
+		stop_thinking_on_time();
+
+	previous_best_move = best_move;
+	previous_value = value;
+
 	check_time_fast();
+}
+
+/**
+ * @brief Stops the search because time's up (or the node limit was reached). While pondering the clock isn't running, so
+ * instead we keep searching and stop as soon as the GUI sends ponderhit.
+ */
+void MainThread::stop_thinking_on_time()
+{
+	if (pondering)
+	{
+		stop_on_ponderhit = true;
 
-	t1 = high_resolution_clock::now();
+		// ponderhit() may have been called in between, in which case it didn't see the flag
+		if (pondering)
+			return;
+	}
+
+	times_up = true;
+	stop_thinking();
 }
 
-void MainThread::post_statistics()
+/**
+ * @brief Called when the GUI sends ponderhit, i.e. the opponent played the expected move.
+ * The search continues as normal, but now under the real time limits.
+ */
+void MainThread::ponderhit()
 {
+	pondering = false;
+
+	if (stop_on_ponderhit)
+		stop_thinking();
+	else
+		notify();
+}
+
+/**
+ * @brief The GUI does not expect a bestmove while pondering or in an infinite search,
+ * so wait until it sends either stop or ponderhit.
+ */
+void MainThread::wait_for_stop_or_ponderhit()
+{
+	wait_for_stop([&] { return !limits.infinite && !pondering; });
+}
+
+void MainThread::post_statistics(const bool force)
+{
+	const time_point now = high_resolution_clock::now();
+
+	if (!force && now - last_statistics < StatisticsInterval)
+		return;
+
+	last_statistics = now;
+
 	const milliseconds time = total_search_time();
 	const Nodes total_nodes = total_nodes_searched();
 	const int nps = (1000 * total_nodes) / (time.count() + 1);
 
 	uci::message(
 		"info nodes {} time {} nps {} hashfull {} hitrate {}",
-		total_nodes, time.count(), nps, tt.hashfull_approx(), tt.hit_rate()
+		total_nodes, time.count(), nps, table->hashfull_approx(), table->hit_rate()
 	);
 }
 
+/**
+ * @brief Memory currently used by this thread, including tables which are allocated on first use
+ *
+ * @return std::size_t Size in bytes
+ */
+std::size_t Thread::memory_usage() const
+{
+	return sizeof(*this) + (pawn_cache ? sizeof(pawns::Cache) : 0);
+}
+
+void MainThread::post_memory_usage() const
+{
+	std::size_t total = memory_usage();
+	uci::message("info string thread {} memory {} KiB", id(), memory_usage() / 1024);
+
+	for (auto &thread : helpers)
+	{
+		total += thread->memory_usage();
+		uci::message("info string thread {} memory {} KiB", thread->id(), thread->memory_usage() / 1024);
+	}
+
+	uci::message("info string threads {} memory {} KiB", helpers.size() + 1, total / 1024);
+}
+
 /**
  * @brief Sets the position about to be searched
  * 
@@ -561,20 +1052,39 @@ void Thread::start_thinking(const Limits &search_limits)
 	start_thinking();
 }
 
+/**
+ * @brief Same as Thread::start_thinking(), but also enters ponder mode if requested.
+ * This must happen before the thread is woken up, so that an early ponderhit isn't lost.
+ *
+ * @param search_limits
+ */
+void MainThread::start_thinking(const Limits &search_limits)
+{
+	pondering = search_limits.ponder;
+	stop_on_ponderhit = false;
+
+	Thread::start_thinking(search_limits);
+}
+
 /**
  * @brief Reset all counters/statistics/results
  */
 void Thread::clear()
 {
-	id_depth = sel_depth = 0;
+	id_depth = sel_depth = completed_depth = 0;
 	nodes = qnodes = 0;
 	heuristics.clear();
 	root_pv.clear();
 	root_value = -Infinite;
+	root_lines.clear();
+	pv_index = 0;
 }
 
-MainThread::MainThread()
-	: Thread(0), helpers(), t0(), t1(), times_up(false)
+MainThread::MainThread(threading::ThreadPool *pool, std::size_t worker)
+	: Thread(0, pool, worker), helper_pool(), helpers(), binding(threading::Binding::None),
+	  time_manager(), t0(), t1(), last_statistics(), times_up(false),
+	  pondering(false), stop_on_ponderhit(false), iteration_callback(),
+	  best_move_changes(0), previous_best_move(), previous_value(-Infinite)
 {
 }
 
@@ -609,11 +1119,70 @@ void MainThread::clear()
  */
 void MainThread::resize_helpers(std::size_t n)
 {
-	while (helpers.size() > n)
-		helpers.pop_back();
+	if (helpers.size() == n)
+		return;
+
+	// Helpers must be destroyed before the pool they run in
+	helpers.clear();
+	helper_pool = n ? std::make_unique<threading::ThreadPool>(n) : nullptr;
+
+	if (helper_pool && binding != threading::Binding::None)
+		helper_pool->bind(binding, 1);
+
+	for (std::size_t i = 1; i <= n; ++i)
+	{
+		helpers.push_back(std::make_unique<Thread>(i, helper_pool.get(), i - 1));
+		helpers.back()->set_parallel_search(parallel_search);
+		helpers.back()->set_table(*table);
+	}
+}
+
+/**
+ * @brief Sets the CPU affinity of the main thread and all helpers
+ *
+ * @param thread_binding
+ */
+void MainThread::set_binding(const threading::Binding thread_binding)
+{
+	binding = thread_binding;
+
+	bind(binding);
+
+	if (helper_pool)
+		helper_pool->bind(binding, 1);
 
-	while (helpers.size() < n)
-		helpers.push_back(std::make_unique<Thread>(helpers.size() + 1));
+	// Pawn caches were first touched under the old binding, possibly on another node
+	free_pawn_cache();
+
+	for (auto &thread : helpers)
+		thread->free_pawn_cache();
+}
+
+/**
+ * @brief Selects the parallel search algorithm for the main thread and all helpers
+ *
+ * @param algorithm
+ */
+void MainThread::set_parallel_search(const ParallelSearch algorithm)
+{
+	Thread::set_parallel_search(algorithm);
+
+	for (auto &thread : helpers)
+		thread->set_parallel_search(algorithm);
+}
+
+/**
+ * @brief Sets the transposition table used by the main thread and all helpers.
+ * The table must outlive the search.
+ *
+ * @param transposition_table
+ */
+void MainThread::set_table(TranspositionTable &transposition_table)
+{
+	Thread::set_table(transposition_table);
+
+	for (auto &thread : helpers)
+		thread->set_table(transposition_table);
 }
 
 milliseconds MainThread::total_search_time() const
@@ -4,6 +4,8 @@
 #include "movegen.hh"
 #include "position.hh"
 #include "pawns.hh"
+#include "timeman.hh"
+#include "tt.hh"
 #include "types.hh"
 #include "uci.hh"
 
@@ -13,15 +15,10 @@
 #include "util/hashtable.hh"
 
 #include <atomic>
-#include <chrono>
+#include <functional>
 
 namespace chess::search
 {
-	using std::chrono::duration_cast;
-	using std::chrono::milliseconds;
-	using std::chrono::high_resolution_clock;
-	using time_point = high_resolution_clock::time_point;
-
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #if defined(NDEBUG)
@@ -30,46 +27,60 @@ namespace chess::search
 	constexpr Nodes CheckTimeEvery = 16384;
 #endif
 
+	// Search statistics are posted at most this often, and once more at the end of the search
+	constexpr milliseconds StatisticsInterval {100};
+
+	// Aspiration window fail-high/low bounds are only posted after searching for this long,
+	// at fast time controls they are too frequent to be useful
+	constexpr milliseconds BoundInfoDelay {1000};
+
 	constexpr Depth LMRDepthLimit = 3;
 	constexpr int LMRMoveNumber   = 3;
 	constexpr int LMRMoveNumber2  = 10; 
 
-	constexpr milliseconds Overhead = milliseconds {50};
+	// Initial half-width of the aspiration window. The window grows by 50% on each
+	// re-search, and is abandoned in favour of a full window past the maximum.
+	constexpr Value AspirationWindowDelta    = 25;
+	constexpr Value AspirationWindowMaxDelta = 500;
+
+	// Lazy SMP: helper threads skip some iterations so that they don't all search the same depth
+	// at the same time. Helper n uses schedule (n - 1) % SkipSchedules, skipping a depth when
+	// ((depth + phase) / size) is odd.
+	constexpr std::size_t SkipSchedules = 20;
+	constexpr util::array_t<int, SkipSchedules> SkipSize
+		{1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+	constexpr util::array_t<int, SkipSchedules> SkipPhase
+		{0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+	// Lazy SMP: helper threads centre their aspiration windows slightly away from the previous
+	// score, so that they fail high/low at different times to the main thread.
+	constexpr util::array_t<int, 4> AspirationCentreOffsets {0, 10, -10, 20};
+
+	// Added to every thread's score before voting for the best move, so that the
+	// thread with the lowest score still has a say, proportional to its depth
+	constexpr int VoteScoreMargin = 15;
+
+	// ABDADA: moves are only deferred at nodes with at least this much depth remaining,
+	// below that the cost of deferring outweighs the cost of searching a move twice.
+	constexpr Depth ABDADADeferDepth = 3;
 
-	// Half of the aspiration window size
-	constexpr Value AspirationWindowHalfWidth = 50;
+	// Size of the table of moves currently being searched, must be a power of two
+	constexpr std::size_t ABDADATableSize = 32768;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 	/**
-	 * @brief Time control
+	 * @brief Parallel search algorithm used by helper threads
 	 */
-	struct TimeControl
+	enum class ParallelSearch
 	{
-		milliseconds wtime = {}, winc = {}, btime = {}, binc = {};
-		milliseconds movetime = {};
-		Depth movestogo = 0;
+		// All threads search the whole tree independently, sharing only the transposition
+		// table, and helpers skip some depths to diversify
+		LazySMP,
 
-		constexpr bool is_sudden_death() const
-		{
-			return movestogo == 0;
-		}
-
-		constexpr bool is_nonzero() const
-		{
-			return wtime != wtime.zero() || winc != winc.zero()
-				|| btime != btime.zero() || binc != binc.zero() || movetime != movetime.zero();
-		}
-
-		constexpr milliseconds time(const Colour us)
-		{
-			return us == Colour::White ? wtime : btime;
-		}
-
-		constexpr milliseconds inc(const Colour us)
-		{
-			return us == Colour::White ? winc : binc;
-		}
+		// All threads search the same depth. A move being searched by another thread
+		// is deferred until the rest of the moves at that node have been searched.
+		ABDADA
 	};
 
 	/**
@@ -82,6 +93,18 @@ namespace chess::search
 		bool ponder = false, infinite = false;
 		Depth depth = 0, mate = 0;
 		Nodes nodes = 0;
+
+		// Only search these root moves, if not empty
+		MoveSequence searchmoves = {};
+	};
+
+	/**
+	 * @brief Line found by searching the root, there is one per MultiPV
+	 */
+	struct RootLine
+	{
+		MoveSequence pv;
+		Value value;
 	};
 
 	/**
@@ -98,20 +121,40 @@ namespace chess::search
 		Position root_position;
 		KeyHistory key_history;
 		Limits limits;
+		ParallelSearch parallel_search;
+
+		// Shared by the main thread and its helpers, the global table unless set otherwise
+		TranspositionTable *table;
 
 	private:
 		Depth id_depth, sel_depth;
-		std::atomic<Nodes> nodes, qnodes;
 
-		std::unique_ptr<pawns::Cache> pawn_cache;
+		// Depth of the last iteration which was searched to completion. Results from
+		// an iteration interrupted by stop_thinking() are discarded, so this may be
+		// less than id_depth.
+		Depth completed_depth;
+
+		// Written by this thread at every node and read by the main thread when polling,
+		// so they are kept on a cache line of their own
+		alignas(threading::CacheLineSize) std::atomic<Nodes> nodes, qnodes;
+
+		// Allocated on first use by the thread itself, so that the memory is local to the node
+		// the thread is bound to, and idle threads don't use any. Freed when the binding changes.
+		alignas(threading::CacheLineSize) std::unique_ptr<pawns::Cache> pawn_cache;
 
 		Heuristics heuristics;
 
 		MoveSequence root_pv;
 		Value root_value;
 
+		// MultiPV: lines from the last completed iteration, best first, and the first
+		// moves of the lines found so far in the current iteration, which are skipped at the root
+		std::vector<RootLine> root_lines;
+		MoveSequence excluded_moves;
+		std::size_t multipv, pv_index;
+
 	public:
-		Thread(std::size_t id);
+		Thread(std::size_t id, threading::ThreadPool *pool = nullptr, std::size_t worker = 0);
 
 		Value search(const Position &position, Value alpha, Value beta, const Depth depth,
 					 const Depth plies_to_root, MoveSequence &pv);
@@ -119,6 +162,12 @@ namespace chess::search
 		Value qsearch(const Position &position, Value alpha, Value beta,
 					  const Depth plies_to_root, MoveSequence &pv);
 
+		Value aspiration_search(const Value previous_value, MoveSequence &pv);
+
+		bool is_excluded_root_move(const Move move) const;
+		bool may_save_result(const Depth plies_to_root) const;
+		bool should_abort(const Nodes total_nodes_searched);
+
 		void think() override;
 
 		void initialise(const Position &root_position, const KeyHistory &key_history);
@@ -128,41 +177,97 @@ namespace chess::search
 
 		void clear();
 
+		void set_parallel_search(const ParallelSearch algorithm) { parallel_search = algorithm; }
+
+		void set_table(TranspositionTable &transposition_table) { table = &transposition_table; }
+		void set_multipv(const std::size_t lines) { multipv = lines; }
+
 		bool is_main_thread() const { return id() == 0; }
 
 		Nodes nodes_searched() const { return nodes.load(std::memory_order_relaxed); }
 		Nodes qnodes_searched() const { return qnodes.load(std::memory_order_relaxed); }
-		Depth depth_reached() const { return id_depth; }
+		Depth depth_reached() const { return completed_depth; }
 		const MoveSequence &principal_variation() const { return root_pv; }
 		Value best_value() const { return root_value; }
+
+		std::size_t memory_usage() const;
+
+		void free_pawn_cache() { pawn_cache.reset(); }
 	};
 
 	class MainThread : public Thread
 	{
 	private:
+		// Helpers run as tasks in a pool, which is started and stopped all at once.
+		// Helper i always runs on worker i - 1, which is bound as thread i.
+		std::unique_ptr<threading::ThreadPool> helper_pool;
 		std::vector<std::unique_ptr<Thread>> helpers;
 
-		time_point t0, t1;
+		threading::Binding binding;
+
+		TimeManager time_manager;
+		time_point t0, t1, last_statistics;
 		bool times_up;
 
+		// Set while pondering, cleared by ponderhit()
+		std::atomic<bool> pondering, stop_on_ponderhit;
+
+		// Called by the main thread after each completed iteration, if set
+		std::function<void (const MainThread &)> iteration_callback;
+
+		// Used by the time manager to extend the search if the root is unstable
+		double best_move_changes;
+		Move previous_best_move;
+		Value previous_value;
+
 	public:
-		MainThread();
+		MainThread(threading::ThreadPool *pool = nullptr, std::size_t worker = 0);
 
 		void think() override;
 
+		void start_thinking(const Limits &limits);
+		using Thread::start_thinking;
+
 		void check_time_fast();
 		void check_time_slow();
+		void stop_thinking_on_time();
+
+		void ponderhit();
 
-		void post_statistics();
+		void post_statistics(const bool force = false);
 
 		void initialise(const Position &root_position, const KeyHistory &key_history);
 		void clear();
 
 		void resize_helpers(std::size_t n);
 
+		void set_parallel_search(const ParallelSearch algorithm);
+
+		void set_table(TranspositionTable &transposition_table);
+
+		void set_binding(const threading::Binding thread_binding);
+
 		milliseconds total_search_time() const;
 		milliseconds iteration_time() const;
 
 		Nodes total_nodes_searched() const;
+
+		void post_memory_usage() const;
+
+		void on_iteration(std::function<void (const MainThread &)> callback)
+		{
+			iteration_callback = std::move(callback);
+		}
+
+		void post_iteration() const
+		{
+			if (iteration_callback)
+				iteration_callback(*this);
+		}
+
+	private:
+		void wait_for_stop_or_ponderhit();
+
+		const Thread *select_best_thread() const;
 	};
 } // chess::search
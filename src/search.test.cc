@@ -0,0 +1,104 @@
+#define CATCH_CONFIG_RUNNER
+#include "catch2/catch.hpp"
+
+#include "search.hh"
+#include "tt.hh"
+#include "uci.hh"
+
+using namespace chess;
+
+/**
+ * @brief Searches a position with the given limits on a single thread, returns the main thread's PV
+ */
+static MoveSequence search_position(search::MainThread &main_thread, const std::string &fen,
+									const search::Limits &limits, const bool clear_table = true)
+{
+	const Position position {fen};
+
+	if (clear_table)
+		tt.clear();
+
+	main_thread.initialise(position, {position.key()});
+	main_thread.start_thinking(limits);
+	main_thread.wait_until_idle();
+
+	return main_thread.principal_variation();
+}
+
+TEST_CASE("Node limit", "[search]")
+{
+	search::MainThread main_thread;
+
+	search::Limits limits;
+	limits.nodes = 5000;
+
+	const MoveSequence pv = search_position(main_thread, fens::Startpos, limits);
+
+	REQUIRE(!pv.empty());
+	REQUIRE(MoveList {Position {fens::Startpos}}.find(pv[0]));
+
+	// The search stops soon after the limit, rather than running until the maximum depth
+	REQUIRE(main_thread.total_nodes_searched() < 2 * limits.nodes);
+}
+
+TEST_CASE("Root drawn by the fifty move rule", "[search]")
+{
+	const std::string fen = "4k3/8/8/8/8/8/8/4K2R w K - 100 80";
+
+	search::MainThread main_thread;
+
+	search::Limits limits;
+	limits.depth = 5;
+
+	const MoveSequence pv = search_position(main_thread, fen, limits);
+
+	REQUIRE(!pv.empty());
+	REQUIRE(MoveList {Position {fen}}.find(pv[0]));
+	REQUIRE(main_thread.depth_reached() == limits.depth);
+}
+
+TEST_CASE("Restricted root result isn't reused", "[search]")
+{
+	// Black to move, e6e5 attacks the queen, which simply takes the pawn
+	const std::string fen = "6k1/8/4p3/8/3Q4/8/8/6K1 b - - 0 1";
+	const std::string after_e5 = "6k1/8/8/4p3/3Q4/8/8/6K1 w - - 0 2";
+
+	search::MainThread main_thread;
+
+	search::Limits limits;
+	limits.depth = 4;
+
+	search_position(main_thread, fen, limits);
+
+	const Move best_move = main_thread.principal_variation()[0];
+	const Value best_value = main_thread.best_value();
+
+	// Leave the queen en prise after e6e5, the result is only valid for that move
+	search::Limits restricted;
+	restricted.depth = 4;
+	restricted.searchmoves = {uci::parse_move("g1h1")};
+
+	search_position(main_thread, after_e5, restricted, false);
+
+	// If the restricted result had been saved, e6e5 would appear to win the queen
+	search_position(main_thread, fen, limits, false);
+
+	REQUIRE(main_thread.principal_variation()[0] == best_move);
+	REQUIRE(main_thread.best_value() == best_value);
+}
+
+int main(int argc, char *argv[])
+{
+	bitboards::init();
+	magics::init();
+
+	uci::quiet = true;
+
+	Catch::Session session;
+
+	int status = session.applyCommandLine(argc, argv);
+	if (status == 0)
+		status = session.run();
+
+	return status;
+}
@@ -0,0 +1,130 @@
+#include "affinity.hh"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#	include <pthread.h>
+#	include <sched.h>
+#endif
+
+using namespace threading;
+
+/**
+ * @brief Parses a Linux CPU list, e.g. "0-15,32-47"
+ *
+ * @param s
+ * @return CpuList
+ */
+static CpuList parse_cpu_list(const std::string &s)
+{
+	CpuList cpus;
+	std::istringstream iss {s};
+	std::string range;
+
+	while (std::getline(iss, range, ','))
+	{
+		unsigned first = 0, last = 0;
+		char dash = 0;
+
+		std::istringstream range_ss {range};
+		if (!(range_ss >> first))
+			continue;
+
+		last = (range_ss >> dash >> last) && dash == '-' ? last : first;
+
+		for (unsigned cpu = first; cpu <= last; ++cpu)
+			cpus.push_back(cpu);
+	}
+
+	return cpus;
+}
+
+/**
+ * @brief Reads the NUMA topology from sysfs. If it isn't available, all CPUs are
+ * assumed to belong to one node.
+ *
+ * @return std::vector<CpuList> CPUs belonging to each node
+ */
+static std::vector<CpuList> detect_numa_nodes()
+{
+	std::vector<CpuList> nodes;
+
+#if defined(__linux__)
+	for (unsigned node = 0; ; ++node)
+	{
+		std::ifstream file {"/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"};
+		std::string cpulist;
+
+		if (!file || !std::getline(file, cpulist))
+			break;
+
+		// Skip memory-only nodes
+		if (CpuList cpus = parse_cpu_list(cpulist); !cpus.empty())
+			nodes.push_back(std::move(cpus));
+	}
+#endif
+
+	if (nodes.empty())
+	{
+		CpuList cpus;
+
+		for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+			cpus.push_back(cpu);
+
+		nodes.push_back(cpus);
+	}
+
+	return nodes;
+}
+
+const std::vector<CpuList> &threading::numa_nodes()
+{
+	static const std::vector<CpuList> nodes = detect_numa_nodes();
+	return nodes;
+}
+
+/**
+ * @brief Restricts a thread to a set of CPUs, depending on the binding mode.
+ * Consecutive thread indices are assigned to different nodes, so that a small number
+ * of threads still uses the memory bandwidth and caches of every node.
+ *
+ * @param handle Thread to bind
+ * @param index Index of the thread, 0 for the main thread
+ * @param binding
+ * @return true if the affinity was set
+ */
+bool threading::bind_thread(std::thread::native_handle_type handle, std::size_t index, Binding binding)
+{
+	const std::vector<CpuList> &nodes = numa_nodes();
+	CpuList cpus;
+
+	if (binding == Binding::None)
+	{
+		for (const CpuList &node : nodes)
+			cpus.insert(cpus.end(), node.begin(), node.end());
+	}
+	else
+	{
+		const CpuList &node = nodes[index % nodes.size()];
+
+		if (binding == Binding::Cores)
+			cpus.push_back(node[(index / nodes.size()) % node.size()]);
+		else
+			cpus = node;
+	}
+
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	for (unsigned cpu : cpus)
+		CPU_SET(cpu, &set);
+
+	return pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+#else
+	static_cast<void>(handle);
+	return false;
+#endif
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace threading
+{
+	/**
+	 * @brief How search threads are placed on the machine
+	 */
+	enum class Binding
+	{
+		// Threads are scheduled freely by the OS
+		None,
+
+		// Each thread is pinned to one logical CPU, threads are spread over NUMA nodes
+		Cores,
+
+		// Each thread may run on any CPU of one NUMA node, threads are spread over nodes
+		NUMA
+	};
+
+	using CpuList = std::vector<unsigned>;
+
+	extern const std::vector<CpuList> &numa_nodes();
+
+	extern bool bind_thread(std::thread::native_handle_type handle, std::size_t index, Binding binding);
+} // threading
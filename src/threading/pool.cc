@@ -0,0 +1,241 @@
+#include "pool.hh"
+
+using namespace threading;
+
+/**
+ * @brief Index of the calling thread in the pool it belongs to, if any.
+ * Tasks submitted by a worker go to its own queue, where they are likely to run on the same core.
+ */
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local std::size_t current_index = 0;
+
+ThreadPool::ThreadPool(std::size_t n)
+	: queues(), workers(), queued(0), sleeping(0), next_queue(0),
+	  mutex(), cv(), done_cv(), quit(false)
+{
+	for (std::size_t i = 0; i < n; ++i)
+		queues.push_back(std::make_unique<Queue>());
+
+	for (std::size_t i = 0; i < n; ++i)
+		workers.emplace_back(&ThreadPool::loop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock {mutex};
+		quit = true;
+	}
+
+	cv.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+}
+
+/**
+ * @brief Queues a task to be run by one of the workers.
+ * Only one worker is woken, and only if some are asleep, so submitting is cheap when busy.
+ *
+ * @param task
+ * @param group Group to add the task to, must outlive the task
+ */
+void ThreadPool::submit(Task task, TaskGroup &group)
+{
+	// Without workers, run the task immediately
+	if (queues.empty())
+	{
+		task();
+		return;
+	}
+
+	group.pending.fetch_add(1, std::memory_order_relaxed);
+
+	// Count the task before it becomes visible, so that queued never underflows
+	queued.fetch_add(1);
+
+	const std::size_t index = current_pool == this
+							? current_index
+							: next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+	Queue &queue = *queues[index];
+	queue.lock.lock();
+	queue.tasks.push_back({std::move(task), &group});
+	queue.lock.unlock();
+
+	// A worker increments sleeping (with the mutex held) before checking queued,
+	// so either it sees our task, or we see it asleep and wake it.
+	if (sleeping.load() > 0)
+	{
+		std::lock_guard lock {mutex};
+		cv.notify_one();
+	}
+}
+
+/**
+ * @brief Queues a task to be run by the given worker only. Other workers never steal it.
+ *
+ * @param worker Index of the worker
+ * @param task
+ * @param group Group to add the task to, must outlive the task
+ */
+void ThreadPool::submit_to(std::size_t worker, Task task, TaskGroup &group)
+{
+	// Without workers, run the task immediately
+	if (queues.empty())
+	{
+		task();
+		return;
+	}
+
+	group.pending.fetch_add(1, std::memory_order_relaxed);
+
+	Queue &queue = *queues[worker % queues.size()];
+	queue.pinned_count.fetch_add(1);
+
+	queue.lock.lock();
+	queue.pinned.push_back({std::move(task), &group});
+	queue.lock.unlock();
+
+	// We can't choose which worker is woken, so wake them all to be sure ours is
+	if (sleeping.load() > 0)
+	{
+		std::lock_guard lock {mutex};
+		cv.notify_all();
+	}
+}
+
+/**
+ * @brief Blocks until every task in the group has finished.
+ * Workers run other tasks while waiting, so tasks may themselves submit and wait for subtasks.
+ *
+ * @param group
+ */
+void ThreadPool::wait(TaskGroup &group)
+{
+	if (current_pool == this)
+	{
+		QueuedTask queued_task;
+
+		while (!group.done())
+		{
+			if (take(current_index, queued_task))
+				run(queued_task);
+			else
+				std::this_thread::yield();
+		}
+	}
+	else
+	{
+		std::unique_lock lock {mutex};
+		done_cv.wait(lock, [&] { return group.done(); });
+	}
+}
+
+/**
+ * @brief Sets the CPU affinity of every worker
+ *
+ * @param binding
+ * @param first_index Index of the first worker, passed to bind_thread()
+ */
+void ThreadPool::bind(Binding binding, std::size_t first_index)
+{
+	for (std::size_t i = 0; i < workers.size(); ++i)
+		bind_thread(workers[i].native_handle(), first_index + i, binding);
+}
+
+/**
+ * @brief Takes a task pinned to us, or a task from the back of our own queue,
+ * or steals one from the front of another
+ *
+ * @param index Index of the calling worker
+ * @param queued_task
+ * @return true if a task was found
+ */
+bool ThreadPool::take(std::size_t index, QueuedTask &queued_task)
+{
+	if (Queue &own = *queues[index]; own.pinned_count.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard lock {own.lock};
+
+		if (!own.pinned.empty())
+		{
+			queued_task = std::move(own.pinned.front());
+			own.pinned.pop_front();
+
+			own.pinned_count.fetch_sub(1);
+			return true;
+		}
+	}
+
+	if (queued.load(std::memory_order_relaxed) == 0)
+		return false;
+
+	for (std::size_t i = 0; i < queues.size(); ++i)
+	{
+		Queue &queue = *queues[(index + i) % queues.size()];
+		const bool own_queue = i == 0;
+
+		std::lock_guard lock {queue.lock};
+
+		if (queue.tasks.empty())
+			continue;
+
+		if (own_queue)
+		{
+			queued_task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			queued_task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+
+		queued.fetch_sub(1);
+		return true;
+	}
+
+	return false;
+}
+
+void ThreadPool::run(QueuedTask &queued_task)
+{
+	queued_task.task();
+	queued_task.task = nullptr;
+
+	// Wake up anyone outside the pool waiting for the group, once its last task is done
+	if (queued_task.group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::lock_guard lock {mutex};
+		done_cv.notify_all();
+	}
+}
+
+void ThreadPool::loop(std::size_t index)
+{
+	current_pool = this;
+	current_index = index;
+
+	const Queue &own = *queues[index];
+	QueuedTask queued_task;
+
+	while (true)
+	{
+		if (take(index, queued_task))
+		{
+			run(queued_task);
+			continue;
+		}
+
+		std::unique_lock lock {mutex};
+
+		++sleeping;
+		cv.wait(lock, [&] { return queued.load() > 0 || own.pinned_count.load() > 0 || quit; });
+		--sleeping;
+
+		// Only exit once every submitted task has run
+		if (quit && queued.load() == 0 && own.pinned_count.load() == 0)
+			break;
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "affinity.hh"
+#include "spinlock.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace threading
+{
+	class ThreadPool;
+
+	/**
+	 * @brief Counts the unfinished tasks submitted with it, so that they can be waited for together
+	 */
+	class TaskGroup
+	{
+	private:
+		friend class ThreadPool;
+
+		std::atomic<std::size_t> pending {0};
+
+	public:
+		bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+	};
+
+	/**
+	 * @brief Fixed size pool of worker threads with one task queue per worker.
+	 * Workers take tasks from the back of their own queue and, once it is empty,
+	 * steal from the front of the other queues. Idle workers sleep until a task is submitted.
+	 * Tasks can also be pinned to a worker with submit_to(), and are then never stolen,
+	 * so a task that relies on the worker's CPU binding always runs where it expects.
+	 *
+	 * Tasks must not throw. The destructor runs every task that has been submitted
+	 * before joining the workers, so shutdown is deterministic.
+	 */
+	class ThreadPool
+	{
+	public:
+		using Task = std::function<void()>;
+
+	private:
+		struct QueuedTask
+		{
+			Task task;
+			TaskGroup *group;
+		};
+
+		struct Queue
+		{
+			SpinLock lock;
+			std::deque<QueuedTask> tasks;
+
+			// Tasks only this queue's worker may run, and their count (readable without the lock)
+			std::deque<QueuedTask> pinned;
+			std::atomic<std::size_t> pinned_count {0};
+		};
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+
+		// Total number of tasks in all queues, and number of workers waiting for one
+		std::atomic<std::size_t> queued, sleeping;
+
+		// Queue used for the next task submitted from outside the pool
+		std::atomic<std::size_t> next_queue;
+
+		std::mutex mutex; // Mutex for cv, done_cv, quit
+		std::condition_variable cv, done_cv;
+		bool quit;
+
+	public:
+		ThreadPool(std::size_t n);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool &operator=(const ThreadPool &) = delete;
+
+		std::size_t size() const { return workers.size(); }
+
+		void submit(Task task, TaskGroup &group);
+		void submit_to(std::size_t worker, Task task, TaskGroup &group);
+		void wait(TaskGroup &group);
+
+		void bind(Binding binding, std::size_t first_index);
+
+	private:
+		bool take(std::size_t index, QueuedTask &queued_task);
+		void run(QueuedTask &queued_task);
+		void loop(std::size_t index);
+	};
+} // threading
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#	include <immintrin.h>
+#endif
+
+namespace threading
+{
+	/**
+	 * @brief Hint to the CPU that we are in a spin-wait loop
+	 */
+	inline void cpu_relax()
+	{
+#if defined(__x86_64__) || defined(_M_X64)
+		_mm_pause();
+#endif
+	}
+
+	/**
+	 * @brief Test-and-test-and-set spinlock with exponential backoff.
+	 * Once the backoff reaches its limit, the waiting thread yields instead of spinning,
+	 * so that a descheduled lock holder can run on an oversubscribed machine.
+	 */
+	struct SpinLock
+	{
+		static constexpr unsigned MaxBackoff = 64;
+
+		std::atomic<bool> locked {false};
+
+		void lock()
+		{
+			unsigned backoff = 1;
+
+			while (locked.exchange(true, std::memory_order_acquire))
+			{
+				// Wait until the lock looks free before trying to take it again,
+				// so that waiting threads don't bounce the cache line around.
+				while (locked.load(std::memory_order_relaxed))
+				{
+					if (backoff <= MaxBackoff)
+					{
+						for (unsigned i = 0; i < backoff; ++i)
+							cpu_relax();
+
+						backoff *= 2;
+					}
+					else
+						std::this_thread::yield();
+				}
+			}
+		}
+
+		bool try_lock()
+		{
+			return !locked.load(std::memory_order_relaxed)
+				&& !locked.exchange(true, std::memory_order_acquire);
+		}
+
+		void unlock()
+		{
+			locked.store(false, std::memory_order_release);
+		}
+	};
+} // threading
@@ -3,10 +3,14 @@
 
 using namespace threading;
 
-Thread::Thread(std::size_t thread_id)
-	: thread_id(thread_id), cv(), mutex(), stop(false), idle(false), quit(false),
-	  thread(&Thread::loop, this)
+Thread::Thread(std::size_t thread_id, ThreadPool *pool, std::size_t worker)
+	: thread_id(thread_id), cv(), signal_cv(), mutex(), stop(false), idle(false), quit(false),
+	  pool(pool), worker(worker), task(), thread()
 {
+	if (pool)
+		return;
+
+	thread = std::thread(&Thread::loop, this);
 	wait_until_idle();
 }
 
@@ -15,6 +19,9 @@ Thread::~Thread()
 	stop_thinking();
 	wait_until_idle();
 
+	if (pool)
+		return;
+
 	mutex.lock();
 	quit = true;
 	idle = false;
@@ -32,6 +39,9 @@ std::size_t Thread::id() const
 
 bool Thread::is_idle()
 {
+	if (pool)
+		return task.done();
+
 	std::lock_guard lock {mutex};
 	return idle;
 }
@@ -43,12 +53,25 @@ bool Thread::should_stop()
 
 void Thread::wait_until_idle()
 {
+	if (pool)
+	{
+		pool->wait(task);
+		return;
+	}
+
 	std::unique_lock lock {mutex};
 	cv.wait(lock, [&] { return idle; });
 }
 
 void Thread::start_thinking()
 {
+	if (pool)
+	{
+		stop = false;
+		pool->submit_to(worker, [this] { think(); }, task);
+		return;
+	}
+
 	std::lock_guard lock {mutex};
 
 	stop = false;
@@ -59,7 +82,29 @@ void Thread::start_thinking()
 
 void Thread::stop_thinking()
 {
+	// Hold the mutex so that the signal can't be missed by a thread in wait_for_stop()
+	std::lock_guard lock {mutex};
+
 	stop = true;
+	signal_cv.notify_all();
+}
+
+/**
+ * @brief Sets the CPU affinity of this thread, using its id as the index.
+ * Threads running in a pool are bound through the pool instead.
+ *
+ * @param binding
+ * @return true if the affinity was set
+ */
+bool Thread::bind(Binding binding)
+{
+	return !pool && bind_thread(thread.native_handle(), id(), binding);
+}
+
+void Thread::notify()
+{
+	std::lock_guard lock {mutex};
+	signal_cv.notify_all();
 }
 
 void Thread::loop()
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "pool.hh"
+
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
@@ -12,35 +14,32 @@ namespace threading
 		return std::thread::hardware_concurrency();
 	}
 
-	struct SpinLock
-	{
-		std::atomic_flag flag;
-
-		void lock()
-		{
-			while (flag.test_and_set(std::memory_order_acquire)) {}
-		}
-
-		void unlock()
-		{
-			flag.clear(std::memory_order_release);
-		}
-	};
+	// Data written by one thread and read by others is aligned to this, to avoid false sharing
+	constexpr std::size_t CacheLineSize = 64;
 
+	/**
+	 * @brief Runs think() whenever start_thinking() is called. By default each thread
+	 * owns a std::thread, but threads created with a pool run think() as a task in the pool instead,
+	 * always on the same worker, so that they keep that worker's CPU binding and memory.
+	 */
 	class Thread
 	{
 	private:
 		const std::size_t thread_id;
-		std::condition_variable cv;
-		std::mutex mutex; // Mutex for cv, idle, quit
+		std::condition_variable cv, signal_cv;
+		std::mutex mutex; // Mutex for cv, signal_cv, idle, quit
 
 		std::atomic<bool> stop;
 		bool idle, quit;
 
+		ThreadPool *pool;
+		std::size_t worker;
+		TaskGroup task;
+
 		std::thread thread;
 
 	public:
-		Thread(std::size_t thread_id = 0);
+		Thread(std::size_t thread_id = 0, ThreadPool *pool = nullptr, std::size_t worker = 0);
 		virtual ~Thread();
 
 		std::size_t id() const;
@@ -53,6 +52,22 @@ namespace threading
 		void start_thinking();
 		void stop_thinking();
 
+		void notify();
+
+		bool bind(Binding binding);
+
+		/**
+		 * @brief Blocks the calling thread until stop_thinking() is called, or until
+		 * @param predicate returns true. The predicate is re-evaluated whenever
+		 * notify() is called, so whoever changes its result must call notify() afterwards.
+		 */
+		template <typename Predicate>
+		void wait_for_stop(Predicate predicate)
+		{
+			std::unique_lock lock {mutex};
+			signal_cv.wait(lock, [&] { return should_stop() || predicate(); });
+		}
+
 		virtual void think() = 0;
 
 	private:
@@ -0,0 +1,92 @@
+#include "timeman.hh"
+
+using namespace chess;
+using namespace chess::search;
+
+TimeManager::TimeManager()
+	: t0(), optimum(), maximum(), enabled(false), fixed(false)
+{
+}
+
+/**
+ * @brief Computes the optimum and maximum search times for the side to move
+ *
+ * @param tc Time control sent by the GUI
+ * @param us Side to move
+ * @param start Time at which the search started
+ */
+void TimeManager::init(const TimeControl &tc, const Colour us, const time_point start)
+{
+	t0 = start;
+	enabled = tc.is_nonzero();
+	fixed = tc.movetime != tc.movetime.zero();
+
+	if (!enabled)
+		return;
+
+	// Fixed time per move, there is nothing to manage
+	if (fixed)
+	{
+		optimum = maximum = util::max(tc.movetime - Overhead, milliseconds {1});
+		return;
+	}
+
+	const milliseconds remaining = util::max(tc.time(us) - Overhead, milliseconds {1});
+	const int movestogo = tc.is_sudden_death() ? SuddenDeathMovesToGo
+											   : util::min(int(tc.movestogo), SuddenDeathMovesToGo);
+
+	// Spread the remaining time, plus the increments we expect to receive,
+	// evenly over the moves left until the next time control.
+	optimum = (remaining + tc.inc(us) * (movestogo - 1)) / movestogo;
+	maximum = util::min(optimum * MaximumTimeRatio, (remaining * MaximumTimePercent) / 100);
+	optimum = util::min(optimum, maximum);
+}
+
+milliseconds TimeManager::elapsed() const
+{
+	return duration_cast<milliseconds>(high_resolution_clock::now() - t0);
+}
+
+/**
+ * @brief Optimum time, extended if the best move keeps changing or the score is dropping
+ *
+ * @param best_move_changes Decaying count of best move changes between iterations
+ * @param previous_value Score from the previous iteration
+ * @param value Score from the latest iteration
+ * @return milliseconds
+ */
+milliseconds TimeManager::scaled_optimum_time(const double best_move_changes,
+											  const Value previous_value, const Value value) const
+{
+	const double instability = 1.0 + best_move_changes;
+	const double falling = util::clamp(1.0 + (previous_value - value) / 200.0, 1.0, 1.5);
+
+	const milliseconds scaled {static_cast<long long>(optimum.count() * instability * falling)};
+
+	return util::min(scaled, maximum);
+}
+
+/**
+ * @brief Called after each iteration to decide whether another iteration is worth starting.
+ * An iteration that would be cut short by the maximum time is wasted, so we don't start it,
+ * unless searching for a fixed time per move where any time saved is lost anyway.
+ *
+ * @param last_iteration_time Time taken by the iteration that just finished
+ * @return true
+ * @return false
+ */
+bool TimeManager::can_start_iteration(const milliseconds last_iteration_time,
+									  const double best_move_changes,
+									  const Value previous_value, const Value value) const
+{
+	if (!enabled)
+		return true;
+
+	const milliseconds time = elapsed();
+
+	if (fixed)
+		return time < maximum;
+
+	return time < scaled_optimum_time(best_move_changes, previous_value, value)
+		&& time + last_iteration_time * IterationTimeRatio < maximum;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "types.hh"
+
+#include <chrono>
+
+namespace chess::search
+{
+	using std::chrono::duration_cast;
+	using std::chrono::milliseconds;
+	using std::chrono::high_resolution_clock;
+	using time_point = high_resolution_clock::time_point;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Time reserved for communication with the GUI on every move
+	constexpr milliseconds Overhead = milliseconds {50};
+
+	// Number of moves assumed to be left in the game under sudden death time controls
+	constexpr int SuddenDeathMovesToGo = 40;
+
+	// The maximum time is at most this multiple of the optimum time...
+	constexpr int MaximumTimeRatio = 5;
+
+	// ...and never more than this fraction (in percent) of the remaining time
+	constexpr int MaximumTimePercent = 80;
+
+	// Estimated ratio between the time taken by one iteration and the next
+	constexpr int IterationTimeRatio = 2;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Time control
+	 */
+	struct TimeControl
+	{
+		milliseconds wtime = {}, winc = {}, btime = {}, binc = {};
+		milliseconds movetime = {};
+		Depth movestogo = 0;
+
+		constexpr bool is_sudden_death() const
+		{
+			return movestogo == 0;
+		}
+
+		constexpr bool is_nonzero() const
+		{
+			return wtime != wtime.zero() || winc != winc.zero()
+				|| btime != btime.zero() || binc != binc.zero() || movetime != movetime.zero();
+		}
+
+		constexpr milliseconds time(const Colour us) const
+		{
+			return us == Colour::White ? wtime : btime;
+		}
+
+		constexpr milliseconds inc(const Colour us) const
+		{
+			return us == Colour::White ? winc : binc;
+		}
+	};
+
+	/**
+	 * @brief Decides how long to search for. The optimum time is the time we aim to use
+	 * for a stable search, and may be extended (up to the maximum time) if the search is
+	 * unstable. The maximum time is a hard limit which is never exceeded.
+	 */
+	class TimeManager
+	{
+	private:
+		time_point t0;
+		milliseconds optimum, maximum;
+		bool enabled, fixed;
+
+	public:
+		TimeManager();
+
+		void init(const TimeControl &tc, const Colour us, const time_point start);
+
+		bool is_enabled() const { return enabled; }
+
+		milliseconds elapsed() const;
+		milliseconds optimum_time() const { return optimum; }
+		milliseconds maximum_time() const { return maximum; }
+
+		milliseconds scaled_optimum_time(const double best_move_changes,
+										 const Value previous_value, const Value value) const;
+
+		bool can_start_iteration(const milliseconds last_iteration_time,
+								 const double best_move_changes,
+								 const Value previous_value, const Value value) const;
+	};
+} // chess::search
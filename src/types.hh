@@ -423,8 +423,13 @@ namespace chess
 		util::array_t<Key, Pieces, Squares> piece_square;
 		util::array_t<Key, Pieces, 8> hand;
 
+		// Pawn keys start from no_pawns, so that they are never zero (an empty hash table entry).
+		// The material key has one key per piece and piece count, xored in for each piece.
+		Key no_pawns;
+		util::array_t<Key, Pieces, Squares> material;
+
 		constexpr Zobrist()
-			: side(), castling(), en_passant(), piece_square(), hand()
+			: side(), castling(), en_passant(), piece_square(), hand(), no_pawns(), material()
 		{
 			util::PRNG prng {736209358, 11200023, 904492875, 3429570234895};
 
@@ -449,6 +454,12 @@ namespace chess
 			
 				key_array[0] = 0;
 			}
+
+			no_pawns = prng.rand();
+
+			for (auto &key_array : material)
+				for (Key &key : key_array)
+					key = prng.rand();
 		}
 	};
 
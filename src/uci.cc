@@ -3,12 +3,222 @@
 #include "tt.hh"
 #include "uci.hh"
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 using namespace chess;
 using namespace chess::uci;
 
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
 Options uci::options;
+bool uci::quiet = false;
+
+// Serialises writes to stdout from the search threads and the UCI thread. A write may
+// block on the pipe to the GUI, so waiting threads sleep instead of spinning.
+static std::mutex output_lock;
+
+/**
+ * @brief Writes to stdout and flushes immediately. stdout is fully buffered when it isn't
+ * a terminal (i.e. when talking to a GUI through a pipe), so without flushing the GUI
+ * would receive output late.
+ *
+ * @param s
+ */
+void uci::write(std::string_view s)
+{
+	std::lock_guard lock {output_lock};
+
+	std::fwrite(s.data(), 1, s.size(), stdout);
+	std::fflush(stdout);
+}
+
+/**
+ * @brief Line read from stdin, and the time at which it was read
+ */
+struct Command
+{
+	std::string line, name;
+	steady_clock::time_point received;
+};
+
+/**
+ * @brief Time taken from reading a command to finishing processing it
+ */
+struct Latency
+{
+	std::size_t count = 0;
+	microseconds total {}, max {};
+};
+
+/**
+ * @brief Commands waiting to be processed. Filled by the input thread, which handles
+ * a few commands (stop, ponderhit, isready) itself when they don't depend on commands
+ * still waiting in the queue.
+ */
+class CommandQueue
+{
+private:
+	std::mutex mutex; // Mutex for everything below
+	std::condition_variable cv;
+
+	std::deque<Command> commands;
+	std::string processing; // Name of the command being processed, empty if none
+	bool closed = false;
+
+	std::map<std::string, Latency> latencies;
+
+public:
+	void push(Command command)
+	{
+		std::lock_guard lock {mutex};
+		commands.push_back(std::move(command));
+		cv.notify_one();
+	}
+
+	/**
+	 * @brief Waits for the next command. Returns false once stdin is closed and
+	 * every command has been processed.
+	 */
+	bool pop(Command &command)
+	{
+		std::unique_lock lock {mutex};
+		cv.wait(lock, [&] { return !commands.empty() || closed; });
+
+		if (commands.empty())
+			return false;
+
+		command = std::move(commands.front());
+		commands.pop_front();
+		processing = command.name;
+
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard lock {mutex};
+		closed = true;
+		cv.notify_one();
+	}
+
+	/**
+	 * @brief Marks the command returned by pop() as processed and records its latency
+	 */
+	void done(const Command &command)
+	{
+		std::lock_guard lock {mutex};
+		processing.clear();
+		record(command);
+	}
+
+	/**
+	 * @brief True if there is no command queued or being processed
+	 */
+	bool is_idle()
+	{
+		std::lock_guard lock {mutex};
+		return commands.empty() && processing.empty();
+	}
+
+	/**
+	 * @brief True if a command which starts a search is queued or being processed.
+	 * A stop or ponderhit received meanwhile refers to that search, so must wait for it.
+	 */
+	bool search_pending()
+	{
+		std::lock_guard lock {mutex};
+
+		if (processing == "go")
+			return true;
+
+		return std::any_of(commands.begin(), commands.end(),
+						   [] (const Command &command) { return command.name == "go"; });
+	}
+
+	void record_immediate(const Command &command)
+	{
+		std::lock_guard lock {mutex};
+		record(command);
+	}
+
+	std::string latency_report()
+	{
+		std::lock_guard lock {mutex};
+		std::string s;
+
+		for (const auto &[name, latency] : latencies)
+		{
+			s += fmt::format("info string latency {} count {} mean {}us max {}us\n",
+							 name, latency.count, latency.total.count() / latency.count,
+							 latency.max.count());
+		}
+
+		return s;
+	}
+
+private:
+	void record(const Command &command)
+	{
+		const microseconds latency = duration_cast<microseconds>(steady_clock::now() - command.received);
+
+		Latency &stats = latencies[command.name];
+		++stats.count;
+		stats.total += latency;
+		stats.max = util::max(stats.max, latency);
+	}
+};
+
+/**
+ * @brief Reads commands from stdin until quit or end of file. Handles stop, ponderhit and
+ * isready immediately if there are no earlier commands they must wait for, so that they
+ * are never delayed by a slow command (e.g. resizing the hash table) being processed.
+ *
+ * @param queue
+ * @param main_thread
+ */
+void read_input(CommandQueue &queue, search::MainThread &main_thread)
+{
+	std::string line;
+
+	while (std::getline(std::cin, line))
+	{
+		Command command {line, {}, steady_clock::now()};
+		std::istringstream {line} >> command.name;
+
+		if (command.name == "isready" && queue.is_idle())
+		{
+			message("readyok");
+			queue.record_immediate(command);
+			continue;
+		}
+		else if ((command.name == "stop" || command.name == "ponderhit") && !queue.search_pending())
+		{
+			if (command.name == "stop")
+				main_thread.stop_thinking();
+			else
+				main_thread.ponderhit();
+
+			queue.record_immediate(command);
+			continue;
+		}
+
+		const bool quit = command.name == "quit";
+		queue.push(std::move(command));
+
+		if (quit)
+			break;
+	}
+
+	queue.close();
+}
 
 /**
  * @brief Format value to UCI notation
@@ -112,6 +322,12 @@ int uci::main(int, char *[])
 	options.add<SpinOption>("Threads", 1, 1, threading::max_threads());
 	options.add<SpinOption>("Hash", TranspositionTable::DefaultSize / 1024 / 1024,
 							1, 16384, "Transposition table size in MiB");
+	options.add<CheckOption>("Ponder", false, "Allow the GUI to let us think on the opponent's time");
+	options.add<SpinOption>("MultiPV", 1, 1, MaxMoves, "Number of best lines to search and report");
+	options.add<ComboOption>("ParallelSearch", "LazySMP", std::unordered_set<std::string> {"LazySMP", "ABDADA"},
+							 "Algorithm used to search with multiple threads");
+	options.add<ComboOption>("ThreadBinding", "None", std::unordered_set<std::string> {"None", "Cores", "NUMA"},
+							 "Pin search threads to cores, or to NUMA nodes");
 	
 #if defined(CRAZYHOUSE)
 	std::unordered_set<std::string> variants {"standard", "crazyhouse"};
@@ -123,14 +339,55 @@ int uci::main(int, char *[])
 
 	// Root position
 	Position root_position;
+	search::KeyHistory key_history;
+
+	// Last position command received, GUIs usually resend the whole game with one more move
+	// each time, so only the new moves need to be applied. position_base is empty if the
+	// root position may not match the last command.
+	std::string position_base;
+	std::vector<std::string> position_moves;
 
 	options.listen("Threads",
 		[&] (const Option *option, const std::string &old_threads, const std::string &new_threads)
 		{
 			uci::message("info string Resizing thread pool from {} to {}...",
 						 old_threads, new_threads);
-			main_thread.resize_helpers(static_cast<const SpinOption *>(option)->value());
+			// The main thread counts as one of the threads
+			main_thread.resize_helpers(static_cast<const SpinOption *>(option)->value() - 1);
 			uci::message("info string Resized thread pool");
+			main_thread.post_memory_usage();
+		}
+	);
+
+	options.listen("MultiPV",
+		[&] (const Option *option, const std::string &, const std::string &)
+		{
+			// Only the main thread searches multiple lines, helpers search the best line only
+			main_thread.set_multipv(static_cast<const SpinOption *>(option)->value());
+		}
+	);
+
+	options.listen("ParallelSearch",
+		[&] (const Option *option, const std::string &, const std::string &)
+		{
+			const std::string &algorithm = static_cast<const ComboOption *>(option)->value();
+
+			main_thread.set_parallel_search(algorithm == "ABDADA" ? search::ParallelSearch::ABDADA
+																  : search::ParallelSearch::LazySMP);
+		}
+	);
+
+	options.listen("ThreadBinding",
+		[&] (const Option *option, const std::string &, const std::string &)
+		{
+			const std::string &binding = static_cast<const ComboOption *>(option)->value();
+
+			main_thread.set_binding(binding == "Cores" ? threading::Binding::Cores
+								  : binding == "NUMA"  ? threading::Binding::NUMA
+													   : threading::Binding::None);
+
+			uci::message("info string Binding threads to {}, {} NUMA node(s)",
+						 binding, threading::numa_nodes().size());
 		}
 	);
 
@@ -144,14 +401,17 @@ int uci::main(int, char *[])
 		}
 	);
 
-	fmt::print("{}", options.to_string());
+	write(options.to_string());
 	message("uciok");
 
-	std::string line;
-	while (std::getline(std::cin, line))
+	CommandQueue queue;
+	std::thread input_thread {read_input, std::ref(queue), std::ref(main_thread)};
+
+	Command command;
+	while (queue.pop(command))
 	{
 		std::string cmd, token;
-		std::istringstream iss {line};
+		std::istringstream iss {command.line};
 		iss >> cmd;
 
 		if (cmd == "isready")
@@ -195,23 +455,24 @@ int uci::main(int, char *[])
 		else if (cmd == "position")
 		{	
 			bool bad = false;
-			search::KeyHistory key_history;
+			std::string base, fen;
+			std::vector<std::string> moves;
 
 			iss >> token;
 			if (token == "startpos")
 			{
-				root_position.set_fen(fens::Startpos);
+				base = token;
+				fen = fens::Startpos;
 				iss >> token; // 'moves'
 			}
 			else if (token == "fen")
 			{
-				std::string fen;
 				iss >> fen;
 
 				while (iss >> token && token != "moves")
 					fen += ' ' + token;
-				
-				root_position.set_fen(fen);
+
+				base = "fen " + fen;
 			}
 			else
 			{
@@ -219,16 +480,29 @@ int uci::main(int, char *[])
 				message("info string Unrecognised parameter '{}'", token);
 			}
 
-			key_history.push_back(root_position.key());
+			while (iss >> token)
+				moves.push_back(token);
+
+			// If this command extends the previous one, continue from the previous root position
+			const bool extends = !bad && base == position_base
+							  && moves.size() >= position_moves.size()
+							  && std::equal(position_moves.begin(), position_moves.end(), moves.begin());
+
+			if (!bad && !extends)
+			{
+				root_position.set_fen(fen);
+				key_history = {root_position.key()};
+				position_moves.clear();
+			}
 
-			while (!bad && iss >> token)
+			for (std::size_t i = position_moves.size(); !bad && i < moves.size(); ++i)
 			{
-				const Move move = uci::parse_move(token);
+				const Move move = uci::parse_move(moves[i]);
 
 				if (!move.is_valid())
 				{
 					bad = true;
-					message("info string Invalid move '{}'", token);
+					message("info string Invalid move '{}'", moves[i]);
 					continue;
 				}
 
@@ -236,6 +510,10 @@ int uci::main(int, char *[])
 				key_history.push_back(root_position.key());
 			}
 
+			// The root position is only known to match a command that was applied in full
+			position_base = bad ? std::string {} : base;
+			position_moves = bad ? std::vector<std::string> {} : moves;
+
 			if (!bad)
 			{
 				main_thread.stop_thinking();
@@ -246,6 +524,7 @@ int uci::main(int, char *[])
 		else if (cmd == "go")
 		{
 			search::Limits limits;
+			bool reading_searchmoves = false;
 
 			while (iss >> token)
 			{
@@ -300,6 +579,9 @@ int uci::main(int, char *[])
 					limits.tc.movetime = search::milliseconds {movetime};
 				}
 				else if (token == "infinite") limits.infinite = true;
+				else if (token == "searchmoves") reading_searchmoves = true;
+				else if (const Move move = parse_move(token); reading_searchmoves && move.is_valid())
+					limits.searchmoves.push_back(move);
 				else message("info string Unrecognised parameter '{}'", token);
 			}
 
@@ -308,20 +590,25 @@ int uci::main(int, char *[])
 			main_thread.start_thinking(limits);
 		}
 		else if (cmd == "ponderhit")
-		{
-		}
+			main_thread.ponderhit();
 		else if (cmd == "show")
-			fmt::print("{}\n", root_position.to_string());
+			message("{}", root_position.to_string());
 		else if (cmd == "eval")
 			eval::evaluate(root_position, true);
 		else if (cmd == "stop")
 			main_thread.stop_thinking();
+		else if (cmd == "latency")
+			write(queue.latency_report());
 		else if (cmd == "quit")
 			break;
 		else
 			message("info string Unknown command");
+
+		queue.done(command);
 	}
 
+	input_thread.join();
+
 	main_thread.stop_thinking();
 	main_thread.wait_until_idle();
 
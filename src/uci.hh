@@ -4,6 +4,7 @@
 #include "ucioption.hh"
 
 #include <iostream>
+#include <iterator>
 
 namespace chess::uci
 {
@@ -12,19 +13,31 @@ namespace chess::uci
 
 	extern Options options;
 
+	// Suppresses all output from message(), used when searching from command line tools
+	extern bool quiet;
+
 	extern std::string format_value(const Value value);
 	extern std::string format_move(const Move move);
 	extern std::string format_variation(const MoveSequence &moves);
 	extern Move parse_move(std::string_view move);
 
+	extern void write(std::string_view s);
+
+	/**
+	 * @brief Formats a line into a buffer on the stack, then writes it to stdout in one go.
+	 * Safe to call from any thread.
+	 */
 	template <typename ...Args>
 	inline void message(std::string_view f, Args &&...args)
 	{
-		fmt::print("{}\n", fmt::vformat(f, fmt::make_format_args(args...)));
-#if defined(_WIN32)
-		// On Windows, outside of a terminal, newlines don't flush the buffer.
-		std::cout << std::flush;
-#endif
+		if (quiet)
+			return;
+
+		fmt::memory_buffer buffer;
+		fmt::vformat_to(std::back_inserter(buffer), f, fmt::make_format_args(args...));
+		buffer.push_back('\n');
+
+		write({buffer.data(), buffer.size()});
 	}
 
 	extern void init();
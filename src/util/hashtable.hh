@@ -41,7 +41,7 @@ public:
 	std::size_t total_hits() const { return hits; }
 	std::size_t total_misses() const { return misses; }
 	std::size_t total_probes() const { return hits + misses; }
-	unsigned hit_rate() const { return (total_hits() * 100) / total_probes(); }
+	unsigned hit_rate() const { return total_probes() ? (total_hits() * 100) / total_probes() : 0; }
 
 	std::size_t index(const Key key) const { return key % Size; }
 
@@ -114,7 +114,7 @@ public:
 	std::size_t total_failed_writes() const { return failed_writes; }
 	std::size_t total_writes() const { return successful_writes + failed_writes; }
 
-	unsigned hit_rate() const { return (total_hits() * 100) / total_probes(); }
+	unsigned hit_rate() const { return total_probes() ? (total_hits() * 100) / total_probes() : 0; }
 
 	std::size_t entry_count() const { return nentries; }
 